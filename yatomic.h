@@ -24,7 +24,7 @@ typedef int32_t atomic_t;
 # define yatomic_add(x, y) (*(x)+=y)
 # define yatomic_init(x) (*(x)=0)
 
-#elif __has_include(<stdatomic.h>) || (Y_C11 && GCC_CHECK_VERSION(4, 9))
+#elif __has_include(<stdatomic.h>) || (defined(Y_C11) && GCC_CHECK_VERSION(4, 9))
 
 # include <stdatomic.h>
 typedef _Atomic(int32_t) atomic_t;
@@ -76,3 +76,19 @@ static inline int32_t yatomic_fetch_and_add(atomic_t *x, int32_t y) {
 
 #endif
 
+/* Operations on pointer sized objects, with explicit barriers. These are
+ * needed by the lock-free data structures, and map directly to compiler
+ * builtins, regardless of the atomic_t implementation chosen above.
+ * yatomic_cas() returns true if the swap happened. */
+#define yatomic_load_relaxed(p) (__atomic_load_n((p), __ATOMIC_RELAXED))
+#define yatomic_load_acquire(p) (__atomic_load_n((p), __ATOMIC_ACQUIRE))
+#define yatomic_store_relaxed(p, v) (__atomic_store_n((p), (v), __ATOMIC_RELAXED))
+#define yatomic_store_release(p, v) (__atomic_store_n((p), (v), __ATOMIC_RELEASE))
+#define yatomic_xchg(p, v) (__atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL))
+#define yatomic_fetch_or(p, v) (__atomic_fetch_or((p), (v), __ATOMIC_ACQ_REL))
+#define yatomic_fetch_and(p, v) (__atomic_fetch_and((p), (v), __ATOMIC_ACQ_REL))
+#define yatomic_cas(p, o, n) ({						\
+	typeof(*(p)) __old = (o);					\
+	__atomic_compare_exchange_n((p), &__old, (n), false,		\
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);})
+#define yatomic_fence() (__atomic_thread_fence(__ATOMIC_SEQ_CST))
@@ -0,0 +1,367 @@
+/* A skiplist of key blocks.
+ *
+ * Each node holds up to YBSKIPLIST_BLOCK sorted uint64_t keys, each with a
+ * value, and the levels of the skiplist index the blocks by their first
+ * key. A lookup only chases pointers until it gets to the right block, and
+ * then finds the key inside the block with a vectorized comparison, so a
+ * list of n keys is walked like a skiplist of n/YBSKIPLIST_BLOCK nodes.
+ *
+ * Keys are unique. Blocks are split in half when they are full. A block that
+ * gets less than a quarter full is merged with a neighbour, or takes keys
+ * from it if the neighbour is too full to merge with, so every block but
+ * the only one stays at least a quarter full.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ydef.h"
+#include "compiler.h"
+#include "yskiplist.h"
+
+/* Number of keys in a block, must be a multiple of 4 */
+#ifndef YBSKIPLIST_BLOCK
+# define YBSKIPLIST_BLOCK 16
+#endif
+
+Y_CTASSERT_GLOBAL(YBSKIPLIST_BLOCK%4 == 0 && YBSKIPLIST_BLOCK < 65536,
+		  "bad YBSKIPLIST_BLOCK");
+
+struct ybskiplist_node {
+	unsigned char h, level;
+	unsigned short n;
+	/* Unused slots are kept at UINT64_MAX */
+	uint64_t keys[YBSKIPLIST_BLOCK];
+	void *vals[YBSKIPLIST_BLOCK];
+	struct ybskiplist_node *next[];
+};
+
+/* Position of a key, node is NULL if there's no such key */
+struct ybskiplist_iter {
+	struct ybskiplist_node *node;
+	unsigned int idx;
+};
+
+#define ybskiplist_iter_key(it) ((it)->node->keys[(it)->idx])
+#define ybskiplist_iter_val(it) ((it)->node->vals[(it)->idx])
+
+static inline struct ybskiplist_node *ybskiplist_new(void){
+	struct ybskiplist_node *h =
+	    calloc(1, sizeof(*h)+MAX_HEIGHT*sizeof(struct ybskiplist_node *));
+	if (h) {
+		h->h = MAX_HEIGHT;
+		h->level = 1;
+	}
+	return h;
+}
+
+static inline struct ybskiplist_node *_ybskiplist_alloc_block(void){
+	int h = yskiplist_gen_height(), i;
+	struct ybskiplist_node *b =
+	    calloc(1, sizeof(*b)+h*sizeof(struct ybskiplist_node *));
+	if (!b)
+		return NULL;
+	b->h = h;
+	for(i = 0; i < YBSKIPLIST_BLOCK; i++)
+		b->keys[i] = UINT64_MAX;
+	return b;
+}
+
+//Free the list, including the head
+static inline void ybskiplist_free(struct ybskiplist_node *h){
+	while(h){
+		struct ybskiplist_node *tmp = h->next[0];
+		free(h);
+		h = tmp;
+	}
+}
+
+/*
+ * Count the keys in a block that are less than key (or equal to it, if
+ * @le is true).
+ *
+ * Written with vector extensions, so the compiler picks whatever SIMD
+ * instructions the target has.
+ */
+static inline unsigned int
+_ybskiplist_block_rank(const struct ybskiplist_node *b, uint64_t key, bool le){
+	typedef uint64_t v4u64 __attribute__((vector_size(32)));
+	typedef int64_t v4i64 __attribute__((vector_size(32)));
+	v4u64 k = {key, key, key, key};
+	v4i64 acc = {0, 0, 0, 0};
+	unsigned int i, r;
+	for(i = 0; i < YBSKIPLIST_BLOCK; i += 4){
+		v4u64 v;
+		memcpy(&v, b->keys+i, sizeof(v));
+		//lanes are -1 where true
+		acc += le ? (v4i64)(v <= k) : (v4i64)(v < k);
+	}
+	r = -(acc[0]+acc[1]+acc[2]+acc[3]);
+	//Padding compares as UINT64_MAX
+	return r < b->n ? r : b->n;
+}
+
+/*
+ * Find the last block whose first key is less than or equal to key, or the
+ * head if there's none.
+ * @preds: if not NULL, filled with the predecessors of the block after it
+ */
+static inline struct ybskiplist_node *
+_ybskiplist_previous(struct ybskiplist_node *head, uint64_t key,
+		     struct ybskiplist_node **preds){
+	int i;
+	struct ybskiplist_node *n = head, *next;
+	for(i = head->level-1; i >= 0; i--){
+		while((next = n->next[i]) && next->keys[0] <= key)
+			n = next;
+		if (preds)
+			preds[i] = n;
+	}
+	return n;
+}
+
+/* Find the predecessors of block b on every level */
+static inline void
+_ybskiplist_block_preds(struct ybskiplist_node *head,
+			struct ybskiplist_node *b,
+			struct ybskiplist_node **preds){
+	int i;
+	struct ybskiplist_node *n = head, *next;
+	for(i = head->level-1; i >= 0; i--){
+		while((next = n->next[i]) && next != b &&
+		      next->keys[0] < b->keys[0])
+			n = next;
+		preds[i] = n;
+	}
+}
+
+static inline void
+_ybskiplist_link(struct ybskiplist_node *head, struct ybskiplist_node **preds,
+		 struct ybskiplist_node *b){
+	int i;
+	for(; head->level < b->h; head->level++)
+		preds[head->level] = head;
+	for(i = 0; i < b->h; i++){
+		b->next[i] = preds[i]->next[i];
+		preds[i]->next[i] = b;
+	}
+}
+
+static inline void
+_ybskiplist_unlink(struct ybskiplist_node *head, struct ybskiplist_node **preds,
+		   struct ybskiplist_node *b){
+	int i;
+	for(i = 0; i < b->h; i++)
+		preds[i]->next[i] = b->next[i];
+	while(head->level > 1 && !head->next[head->level-1])
+		head->level--;
+}
+
+static inline void
+_ybskiplist_block_insert(struct ybskiplist_node *b, unsigned int pos,
+			 uint64_t key, void *val){
+	memmove(b->keys+pos+1, b->keys+pos, (b->n-pos)*sizeof(b->keys[0]));
+	memmove(b->vals+pos+1, b->vals+pos, (b->n-pos)*sizeof(b->vals[0]));
+	b->keys[pos] = key;
+	b->vals[pos] = val;
+	b->n++;
+}
+
+/*
+ * ybskiplist_insert: Insert a key
+ * @return: 0 if inserted, 1 if the key is already in the list, -1 if out
+ * of memory
+ */
+static inline int
+ybskiplist_insert(struct ybskiplist_node *head, uint64_t key, void *val){
+	struct ybskiplist_node *preds[MAX_HEIGHT];
+	struct ybskiplist_node *b = _ybskiplist_previous(head, key, preds), *nb;
+	unsigned int pos, half;
+
+	if (b == head) {
+		//Smaller than everything, goes to the front of the first block
+		b = head->next[0];
+		if (!b) {
+			b = _ybskiplist_alloc_block();
+			if (!b)
+				return -1;
+			_ybskiplist_link(head, preds, b);
+		}
+		pos = 0;
+	} else {
+		pos = _ybskiplist_block_rank(b, key, false);
+		if (pos < b->n && b->keys[pos] == key)
+			return 1;
+	}
+	if (likely(b->n < YBSKIPLIST_BLOCK)) {
+		_ybskiplist_block_insert(b, pos, key, val);
+		return 0;
+	}
+
+	//Split the block, the upper half goes into a new block after it
+	nb = _ybskiplist_alloc_block();
+	if (!nb)
+		return -1;
+	half = YBSKIPLIST_BLOCK/2;
+	nb->n = YBSKIPLIST_BLOCK-half;
+	memcpy(nb->keys, b->keys+half, nb->n*sizeof(b->keys[0]));
+	memcpy(nb->vals, b->vals+half, nb->n*sizeof(b->vals[0]));
+	memset(b->keys+half, 0xff, nb->n*sizeof(b->keys[0]));
+	b->n = half;
+
+	//preds are the predecessors of b's successor, b is one of them
+	_ybskiplist_block_preds(head, b, preds);
+	for(pos = 0; pos < b->h && pos < nb->h; pos++)
+		preds[pos] = b;
+	_ybskiplist_link(head, preds, nb);
+
+	return ybskiplist_insert(head, key, val);
+}
+
+/*
+ * Move the first k keys of b to the end of a, a is right before b. b's
+ * first key only grows, so b stays in place in the index.
+ */
+static inline void
+_ybskiplist_shift_left(struct ybskiplist_node *a, struct ybskiplist_node *b,
+		       unsigned int k){
+	memcpy(a->keys+a->n, b->keys, k*sizeof(a->keys[0]));
+	memcpy(a->vals+a->n, b->vals, k*sizeof(a->vals[0]));
+	a->n += k;
+	b->n -= k;
+	memmove(b->keys, b->keys+k, b->n*sizeof(b->keys[0]));
+	memmove(b->vals, b->vals+k, b->n*sizeof(b->vals[0]));
+	memset(b->keys+b->n, 0xff, k*sizeof(b->keys[0]));
+}
+
+/*
+ * Move the last k keys of a to the front of b, a is right before b. b's
+ * first key stays greater than all keys of a, so b stays in place in the
+ * index.
+ */
+static inline void
+_ybskiplist_shift_right(struct ybskiplist_node *a, struct ybskiplist_node *b,
+			unsigned int k){
+	memmove(b->keys+k, b->keys, b->n*sizeof(b->keys[0]));
+	memmove(b->vals+k, b->vals, b->n*sizeof(b->vals[0]));
+	a->n -= k;
+	memcpy(b->keys, a->keys+a->n, k*sizeof(b->keys[0]));
+	memcpy(b->vals, a->vals+a->n, k*sizeof(b->vals[0]));
+	b->n += k;
+	memset(a->keys+a->n, 0xff, k*sizeof(a->keys[0]));
+}
+
+/*
+ * ybskiplist_delete: Remove a key
+ * @val: if not NULL, set to the value of the removed key
+ * @return: true if the key was found
+ */
+static inline bool
+ybskiplist_delete(struct ybskiplist_node *head, uint64_t key, void **val){
+	struct ybskiplist_node *preds[MAX_HEIGHT];
+	struct ybskiplist_node *b = _ybskiplist_previous(head, key, NULL), *nb, *pb;
+	unsigned int pos;
+	int i;
+
+	if (b == head)
+		return false;
+	pos = _ybskiplist_block_rank(b, key, false);
+	if (pos >= b->n || b->keys[pos] != key)
+		return false;
+	if (val)
+		*val = b->vals[pos];
+
+	//Find the predecessors before the first key changes
+	_ybskiplist_block_preds(head, b, preds);
+	b->n--;
+	memmove(b->keys+pos, b->keys+pos+1, (b->n-pos)*sizeof(b->keys[0]));
+	memmove(b->vals+pos, b->vals+pos+1, (b->n-pos)*sizeof(b->vals[0]));
+	b->keys[b->n] = UINT64_MAX;
+
+	if (b->n == 0) {
+		_ybskiplist_unlink(head, preds, b);
+		free(b);
+		return true;
+	}
+
+	if (b->n >= YBSKIPLIST_BLOCK/4)
+		return true;
+	nb = b->next[0];
+	if (nb && b->n+nb->n <= YBSKIPLIST_BLOCK/2) {
+		//Merge the successor into b
+		memcpy(b->keys+b->n, nb->keys, nb->n*sizeof(b->keys[0]));
+		memcpy(b->vals+b->n, nb->vals, nb->n*sizeof(b->vals[0]));
+		b->n += nb->n;
+		for(i = 0; i < b->h && i < nb->h; i++)
+			preds[i] = b;
+		_ybskiplist_unlink(head, preds, nb);
+		free(nb);
+	} else if (nb) {
+		//The successor is too full, take some of its keys instead
+		_ybskiplist_shift_left(b, nb, (nb->n-b->n)/2);
+	} else if (preds[0] != head) {
+		//b is the last block, do the same with its predecessor
+		pb = preds[0];
+		if (pb->n+b->n <= YBSKIPLIST_BLOCK/2) {
+			memcpy(pb->keys+pb->n, b->keys, b->n*sizeof(b->keys[0]));
+			memcpy(pb->vals+pb->n, b->vals, b->n*sizeof(b->vals[0]));
+			pb->n += b->n;
+			_ybskiplist_unlink(head, preds, b);
+			free(b);
+		} else
+			_ybskiplist_shift_right(pb, b, (pb->n-b->n)/2);
+	}
+	return true;
+}
+
+//Find the smallest key that is greater than or equal to key.
+static inline bool
+ybskiplist_find_ge(struct ybskiplist_node *head, uint64_t key,
+		   struct ybskiplist_iter *it){
+	struct ybskiplist_node *b = _ybskiplist_previous(head, key, NULL);
+	unsigned int pos = 0;
+	if (b != head)
+		pos = _ybskiplist_block_rank(b, key, false);
+	if (pos >= b->n) {
+		//b is either the head or has no key >= key
+		b = b->next[0];
+		pos = 0;
+	}
+	it->node = b;
+	it->idx = pos;
+	return b != NULL;
+}
+
+//Find the largest key that is less than or equal to key.
+static inline bool
+ybskiplist_find_le(struct ybskiplist_node *head, uint64_t key,
+		   struct ybskiplist_iter *it){
+	struct ybskiplist_node *b = _ybskiplist_previous(head, key, NULL);
+	if (b == head) {
+		it->node = NULL;
+		return false;
+	}
+	//b->keys[0] <= key, so the rank is at least 1
+	it->node = b;
+	it->idx = _ybskiplist_block_rank(b, key, true)-1;
+	return true;
+}
+
+static inline bool
+ybskiplist_first(struct ybskiplist_node *head, struct ybskiplist_iter *it){
+	it->node = head->next[0];
+	it->idx = 0;
+	return it->node != NULL;
+}
+
+static inline bool ybskiplist_next(struct ybskiplist_iter *it){
+	if (++it->idx >= it->node->n) {
+		it->node = it->node->next[0];
+		it->idx = 0;
+	}
+	return it->node != NULL;
+}
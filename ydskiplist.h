@@ -0,0 +1,299 @@
+/* A deterministic skiplist.
+ *
+ * This is a 1-2-3 skiplist (Munro, Papadakis and Sedgewick): instead of
+ * giving nodes random heights, the gap between two adjacent nodes of a
+ * level is kept between 1 and 3 nodes of the level right below. Which
+ * makes it a 2-3-4 tree in disguise, so searches take O(log n) steps in
+ * the worst case, not only in expectation. Insertion and deletion fix the
+ * gaps on their way down, and don't have to come back up.
+ *
+ * Elements are on a doubly linked list, with struct ydskiplist_node
+ * embedded in them. Upper levels are made of index nodes, each pointing
+ * down to the first node of its gap. Index nodes are allocated by the
+ * list, so insertion can fail.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "ydef.h"
+
+struct ydskiplist_node {
+	struct ydskiplist_node *next, *prev;
+};
+
+struct _ydskiplist_index {
+	struct _ydskiplist_index *right;
+	/* struct ydskiplist_node on level 1, struct _ydskiplist_index above */
+	void *down;
+	/* The first element under this node, NULL for the heads of levels */
+	struct ydskiplist_node *elem;
+};
+
+struct ydskiplist {
+	/* Head of level 0, not an element */
+	struct ydskiplist_node head;
+	/* Head of level 1 */
+	struct _ydskiplist_index base;
+	/* Head of the top level, and the number of index levels */
+	struct _ydskiplist_index *top;
+	int height;
+};
+
+/* The height of a 2-3-4 tree is at most log2(n)+1 */
+#define YDSKIPLIST_MAX_HEIGHT 64
+
+typedef int (*ydskiplist_cmp)(struct ydskiplist_node *a, void *key);
+
+#define ydskiplist_entry(ptr, type, member) \
+	container_of(ptr, type, member)
+
+#define ydskiplist_empty(l) ((l)->head.next == NULL)
+
+static inline void ydskiplist_init(struct ydskiplist *l){
+	l->head.next = l->head.prev = NULL;
+	l->base.right = NULL;
+	l->base.down = &l->head;
+	l->base.elem = NULL;
+	l->top = &l->base;
+	l->height = 1;
+}
+
+//Next node after c on level lvl
+static inline void *_ydskiplist_sibling(void *c, int lvl){
+	if (lvl == 0)
+		return ((struct ydskiplist_node *)c)->next;
+	return ((struct _ydskiplist_index *)c)->right;
+}
+
+//First element under c, c is on level lvl
+static inline struct ydskiplist_node *_ydskiplist_elem(void *c, int lvl){
+	if (lvl == 0)
+		return c;
+	return ((struct _ydskiplist_index *)c)->elem;
+}
+
+//The node after the last child of x
+static inline void *_ydskiplist_end(struct _ydskiplist_index *x){
+	return x->right ? x->right->down : NULL;
+}
+
+//Number of nodes in the gap of x, x is on level lvl
+static inline int _ydskiplist_nchild(struct _ydskiplist_index *x, int lvl){
+	void *c = x->down, *end = _ydskiplist_end(x);
+	int n = 0;
+	for(; c != end; c = _ydskiplist_sibling(c, lvl-1))
+		n++;
+	return n;
+}
+
+/*
+ * Find the last child of x, x is on level lvl, that is less than key (or
+ * less than or equal to it, if @le is 1). The first child is returned if
+ * there's none.
+ */
+static inline void *
+_ydskiplist_child(struct _ydskiplist_index *x, int lvl, void *key,
+		  ydskiplist_cmp cmp, int le){
+	void *c = x->down, *end = _ydskiplist_end(x), *s;
+	while((s = _ydskiplist_sibling(c, lvl-1)) != end &&
+	      cmp(_ydskiplist_elem(s, lvl-1), key) < le)
+		c = s;
+	return c;
+}
+
+/*
+ * Find the last element that is less than key (or less than or equal to
+ * it, if @le is 1), &l->head if there's none.
+ */
+static inline struct ydskiplist_node *
+_ydskiplist_search(struct ydskiplist *l, void *key, ydskiplist_cmp cmp, int le){
+	void *x = l->top;
+	int lvl;
+	for(lvl = l->height; lvl > 0; lvl--)
+		x = _ydskiplist_child(x, lvl, key, cmp, le);
+	return x;
+}
+
+/*
+ * ydskiplist_insert: Insert an element into the list
+ * @n: the element, inserted after the elements equal to key
+ * @return: 0 on success, -1 if out of memory
+ */
+static inline int
+ydskiplist_insert(struct ydskiplist *l, struct ydskiplist_node *n,
+		  void *key, ydskiplist_cmp cmp){
+	struct _ydskiplist_index *x, *c, *t;
+	struct ydskiplist_node *p;
+	int lvl;
+
+	if (_ydskiplist_nchild(l->top, l->height) == 4) {
+		t = talloc(1, struct _ydskiplist_index);
+		if (!t)
+			return -1;
+		t->down = l->top;
+		l->top = t;
+		l->height++;
+	}
+
+	//Split full gaps on the way down, so there's always room below
+	x = l->top;
+	for(lvl = l->height; lvl > 1; lvl--){
+		c = _ydskiplist_child(x, lvl, key, cmp, 1);
+		if (_ydskiplist_nchild(c, lvl-1) == 4) {
+			void *third = _ydskiplist_sibling(
+			    _ydskiplist_sibling(c->down, lvl-2), lvl-2);
+			t = talloc(1, struct _ydskiplist_index);
+			if (!t)
+				return -1;
+			t->down = third;
+			t->elem = _ydskiplist_elem(third, lvl-2);
+			t->right = c->right;
+			c->right = t;
+			if (cmp(t->elem, key) <= 0)
+				c = t;
+		}
+		x = c;
+	}
+
+	p = _ydskiplist_child(x, 1, key, cmp, 1);
+	n->prev = p;
+	n->next = p->next;
+	if (p->next)
+		p->next->prev = n;
+	p->next = n;
+	return 0;
+}
+
+/*
+ * Make sure c, a child of x on level lvl-1 with 2 children, has at least
+ * 3, by taking a child from one of its siblings, or merging with one.
+ * @return: the node that now covers the gap of c
+ */
+static inline struct _ydskiplist_index *
+_ydskiplist_fix(struct _ydskiplist_index *x, int lvl,
+		struct _ydskiplist_index *c){
+	struct _ydskiplist_index *s = c->right, *p;
+	void *lc;
+	if (s && s != _ydskiplist_end(x)) {
+		if (_ydskiplist_nchild(s, lvl-1) > 2) {
+			s->down = _ydskiplist_sibling(s->down, lvl-2);
+			s->elem = _ydskiplist_elem(s->down, lvl-2);
+		} else {
+			c->right = s->right;
+			free(s);
+		}
+		return c;
+	}
+
+	//c is the last child, x has at least 2
+	for(p = x->down; p->right != c; p = p->right);
+	if (_ydskiplist_nchild(p, lvl-1) > 2) {
+		for(lc = p->down; _ydskiplist_sibling(lc, lvl-2) != c->down;
+		    lc = _ydskiplist_sibling(lc, lvl-2));
+		c->down = lc;
+		c->elem = _ydskiplist_elem(lc, lvl-2);
+		return c;
+	}
+	p->right = c->right;
+	free(c);
+	return p;
+}
+
+/*
+ * ydskiplist_extract_by_key: Remove an element equal to key
+ * @return: the element removed, or NULL if there's none
+ *
+ * Never allocates memory.
+ */
+static inline struct ydskiplist_node *
+ydskiplist_extract_by_key(struct ydskiplist *l, void *key, ydskiplist_cmp cmp){
+	struct _ydskiplist_index *path[YDSKIPLIST_MAX_HEIGHT], *x, *c;
+	struct ydskiplist_node *e;
+	int lvl, npath = 0, i;
+
+	while(l->height > 1 && _ydskiplist_nchild(l->top, l->height) == 1){
+		x = l->top;
+		l->top = x->down;
+		l->height--;
+		free(x);
+	}
+
+	//Grow gaps with 2 nodes on the way down, so there's always a spare
+	x = l->top;
+	for(lvl = l->height; lvl > 1; lvl--){
+		path[npath++] = x;
+		c = _ydskiplist_child(x, lvl, key, cmp, 1);
+		if (_ydskiplist_nchild(c, lvl-1) == 2)
+			c = _ydskiplist_fix(x, lvl, c);
+		x = c;
+	}
+	path[npath++] = x;
+
+	e = _ydskiplist_child(x, 1, key, cmp, 1);
+	if (e == &l->head || cmp(e, key) != 0)
+		return NULL;
+
+	//x has at least 3 children, so e->next is still under x
+	if (x->down == e)
+		x->down = e->next;
+	for(i = 0; i < npath; i++)
+		if (path[i]->elem == e)
+			path[i]->elem = e->next;
+	e->prev->next = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	return e;
+}
+
+//Find the smallest element that is greater than or equal to key.
+static inline struct ydskiplist_node *
+ydskiplist_find_ge(struct ydskiplist *l, void *key, ydskiplist_cmp cmp){
+	return _ydskiplist_search(l, key, cmp, 0)->next;
+}
+
+//Find the largest element that is less than or equal to key.
+static inline struct ydskiplist_node *
+ydskiplist_find_le(struct ydskiplist *l, void *key, ydskiplist_cmp cmp){
+	struct ydskiplist_node *n = _ydskiplist_search(l, key, cmp, 1);
+	return n == &l->head ? NULL : n;
+}
+
+static inline struct ydskiplist_node *ydskiplist_first(struct ydskiplist *l){
+	return l->head.next;
+}
+
+static inline struct ydskiplist_node *
+ydskiplist_prev(struct ydskiplist *l, struct ydskiplist_node *n){
+	return n->prev == &l->head ? NULL : n->prev;
+}
+
+/*
+ * ydskiplist_clear: Remove all elements
+ * @freep: called on every element, can be NULL
+ */
+static inline void
+ydskiplist_clear(struct ydskiplist *l, void (*freep)(struct ydskiplist_node *)){
+	struct _ydskiplist_index *hd = l->top;
+	struct ydskiplist_node *n = l->head.next;
+	int lvl;
+	for(lvl = l->height; lvl > 0; lvl--){
+		struct _ydskiplist_index *down = hd->down, *x = hd->right;
+		while(x){
+			struct _ydskiplist_index *tmp = x->right;
+			free(x);
+			x = tmp;
+		}
+		if (hd != &l->base)
+			free(hd);
+		hd = down;
+	}
+	while(n && freep){
+		struct ydskiplist_node *tmp = n->next;
+		freep(n);
+		n = tmp;
+	}
+	ydskiplist_init(l);
+}
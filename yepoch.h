@@ -0,0 +1,195 @@
+/* Epoch based memory reclamation.
+ *
+ * Readers of a lock-free data structure wrap their accesses in
+ * yepoch_enter()/yepoch_exit(). Writers that unlink an object pass it to
+ * yepoch_retire(), and it's freed once every thread that could still be
+ * holding a reference to it has left its critical section.
+ *
+ * An object retired while the global epoch is e is freed when the global
+ * epoch reaches e+2. The global epoch can only advance when every thread
+ * that is inside a critical section has observed the current epoch, so no
+ * reader can still hold a reference by then.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "ydef.h"
+#include "yatomic.h"
+
+/* Try to advance the global epoch after this many retirements */
+#ifndef YEPOCH_ADVANCE_INTERVAL
+# define YEPOCH_ADVANCE_INTERVAL 64
+#endif
+
+struct yepoch_entry {
+	struct yepoch_entry *next;
+	void (*free)(struct yepoch_entry *);
+};
+
+struct yepoch_thread {
+	/* epoch<<1 | in critical section */
+	unsigned long state;
+	bool in_use;
+	unsigned long limbo_epoch[3];
+	struct yepoch_entry *limbo[3];
+	unsigned int nretired;
+	struct yepoch *domain;
+	struct yepoch_thread *next;
+};
+
+struct yepoch {
+	unsigned long epoch;
+	struct yepoch_thread *threads;
+};
+
+static inline void yepoch_init(struct yepoch *e){
+	e->epoch = 0;
+	e->threads = NULL;
+}
+
+static inline void _yepoch_free_list(struct yepoch_entry *l){
+	while(l){
+		struct yepoch_entry *tmp = l->next;
+		l->free(l);
+		l = tmp;
+	}
+}
+
+/*
+ * yepoch_deinit: Free everything still waiting for reclamation
+ *
+ * No thread may be using @e when this is called.
+ */
+static inline void yepoch_deinit(struct yepoch *e){
+	struct yepoch_thread *t = e->threads;
+	while(t){
+		struct yepoch_thread *tmp = t->next;
+		int i;
+		for(i = 0; i < 3; i++)
+			_yepoch_free_list(t->limbo[i]);
+		free(t);
+		t = tmp;
+	}
+	e->threads = NULL;
+}
+
+/*
+ * yepoch_register: Get a per-thread record for the calling thread
+ * @return: the record, or NULL if out of memory
+ *
+ * Records of unregistered threads are reused.
+ */
+static inline struct yepoch_thread *yepoch_register(struct yepoch *e){
+	struct yepoch_thread *t;
+	for(t = yatomic_load_acquire(&e->threads); t; t = t->next)
+		if (!yatomic_load_relaxed(&t->in_use) &&
+		    yatomic_cas(&t->in_use, false, true))
+			return t;
+
+	t = talloc(1, struct yepoch_thread);
+	if (!t)
+		return NULL;
+	t->in_use = true;
+	t->domain = e;
+	t->next = yatomic_load_relaxed(&e->threads);
+	while(!yatomic_cas(&e->threads, t->next, t))
+		t->next = yatomic_load_relaxed(&e->threads);
+	return t;
+}
+
+static inline void yepoch_enter(struct yepoch_thread *t){
+	unsigned long e = yatomic_load_acquire(&t->domain->epoch);
+	yatomic_store_relaxed(&t->state, (e<<1)|1);
+	yatomic_fence();
+}
+
+static inline void yepoch_exit(struct yepoch_thread *t){
+	yatomic_store_release(&t->state, yatomic_load_relaxed(&t->state)&~1UL);
+}
+
+/*
+ * yepoch_try_advance: Advance the global epoch if every active thread
+ * has observed it
+ * @return: true if the epoch was advanced
+ */
+static inline bool yepoch_try_advance(struct yepoch *e){
+	unsigned long ge = yatomic_load_acquire(&e->epoch);
+	struct yepoch_thread *t;
+	yatomic_fence();
+	for(t = yatomic_load_acquire(&e->threads); t; t = t->next){
+		unsigned long s = yatomic_load_acquire(&t->state);
+		if ((s&1) && (s>>1) != ge)
+			return false;
+	}
+	return yatomic_cas(&e->epoch, ge, ge+1);
+}
+
+/* Free the entries @t retired that no one can reach anymore */
+static inline void yepoch_collect(struct yepoch_thread *t){
+	unsigned long ge = yatomic_load_acquire(&t->domain->epoch);
+	int i;
+	for(i = 0; i < 3; i++){
+		if (!t->limbo[i] || t->limbo_epoch[i]+2 > ge)
+			continue;
+		_yepoch_free_list(t->limbo[i]);
+		t->limbo[i] = NULL;
+	}
+}
+
+/*
+ * yepoch_retire: Free an object once it's not reachable by any reader
+ * @t: record of the calling thread
+ * @n: the entry embedded in the object
+ * @freep: called to free the object
+ *
+ * The object must already be unlinked from the data structure. Can be
+ * called both inside and outside of a critical section.
+ */
+static inline void yepoch_retire(struct yepoch_thread *t,
+				 struct yepoch_entry *n,
+				 void (*freep)(struct yepoch_entry *)){
+	unsigned long ge = yatomic_load_acquire(&t->domain->epoch);
+	int i = ge%3;
+	if (t->limbo_epoch[i] != ge){
+		/* Left over from epoch ge-3, safe to free */
+		_yepoch_free_list(t->limbo[i]);
+		t->limbo[i] = NULL;
+		t->limbo_epoch[i] = ge;
+	}
+	n->free = freep;
+	n->next = t->limbo[i];
+	t->limbo[i] = n;
+
+	if (++t->nretired%YEPOCH_ADVANCE_INTERVAL == 0){
+		yepoch_try_advance(t->domain);
+		yepoch_collect(t);
+	}
+}
+
+/*
+ * yepoch_synchronize: Wait until everything retired so far is freed
+ * @t: record of the calling thread, must not be in a critical section
+ */
+static inline void yepoch_synchronize(struct yepoch_thread *t){
+	unsigned long target = yatomic_load_acquire(&t->domain->epoch)+2;
+	while((long)(yatomic_load_acquire(&t->domain->epoch)-target) < 0)
+		if (!yepoch_try_advance(t->domain))
+			thrd_yield();
+	yepoch_collect(t);
+}
+
+/*
+ * yepoch_unregister: Give the record of the calling thread back
+ *
+ * Waits for a grace period, so everything retired by this thread is
+ * freed before returning.
+ */
+static inline void yepoch_unregister(struct yepoch_thread *t){
+	yepoch_synchronize(t);
+	t->nretired = 0;
+	yatomic_store_release(&t->in_use, false);
+}
@@ -0,0 +1,242 @@
+/* Flat combining.
+ *
+ * Instead of every thread taking a lock to work on a shared data
+ * structure, threads publish their operations in per-thread records, and
+ * whichever thread gets the lock applies everyone's pending operations in
+ * one go, while the others wait for their results. The data structure
+ * stays in the cache of one core, and the lock is taken once per batch
+ * instead of once per operation.
+ *
+ * An operation is a struct yfc_request embedded in a struct holding its
+ * arguments and results, fn is called on it by the combiner. There are
+ * ready made operations for yskiplist.h and ylist.h below.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ydef.h"
+#include "yatomic.h"
+#include "ythread.h"
+#include "ylist.h"
+#include "yskiplist.h"
+
+/* How many times the combiner goes over the records before giving up the
+ * lock, later passes pick up requests published during the earlier ones */
+#ifndef YFC_PASSES
+# define YFC_PASSES 2
+#endif
+
+/* Spin this many times waiting for the combiner before yielding */
+#ifndef YFC_SPINS
+# define YFC_SPINS 1024
+#endif
+
+struct yfc_request {
+	void (*fn)(struct yfc_request *);
+};
+
+struct yfc_record {
+	/* The pending request, NULL once it's done */
+	struct yfc_request *req;
+	bool in_use;
+	struct yfc_record *next;
+};
+
+struct yfc {
+	int lock;
+	struct yfc_record *records;
+};
+
+static inline void yfc_init(struct yfc *fc){
+	fc->lock = 0;
+	fc->records = NULL;
+}
+
+//No thread may be using @fc when this is called.
+static inline void yfc_deinit(struct yfc *fc){
+	struct yfc_record *r = fc->records;
+	while(r){
+		struct yfc_record *tmp = r->next;
+		free(r);
+		r = tmp;
+	}
+	fc->records = NULL;
+}
+
+/*
+ * yfc_register: Get a record for the calling thread
+ * @return: the record, or NULL if out of memory
+ *
+ * Records of unregistered threads are reused.
+ */
+static inline struct yfc_record *yfc_register(struct yfc *fc){
+	struct yfc_record *r;
+	for(r = yatomic_load_acquire(&fc->records); r; r = r->next)
+		if (!yatomic_load_relaxed(&r->in_use) &&
+		    yatomic_cas(&r->in_use, false, true))
+			return r;
+
+	r = talloc(1, struct yfc_record);
+	if (!r)
+		return NULL;
+	r->in_use = true;
+	r->next = yatomic_load_relaxed(&fc->records);
+	while(!yatomic_cas(&fc->records, r->next, r))
+		r->next = yatomic_load_relaxed(&fc->records);
+	return r;
+}
+
+static inline void yfc_unregister(struct yfc_record *r){
+	yatomic_store_release(&r->in_use, false);
+}
+
+//Apply all pending requests, with the lock held.
+static inline void _yfc_combine(struct yfc *fc){
+	int pass;
+	for(pass = 0; pass < YFC_PASSES; pass++){
+		struct yfc_record *r;
+		bool found = false;
+		for(r = yatomic_load_acquire(&fc->records); r; r = r->next){
+			struct yfc_request *req = yatomic_load_acquire(&r->req);
+			if (!req)
+				continue;
+			req->fn(req);
+			yatomic_store_release(&r->req, NULL);
+			found = true;
+		}
+		if (!found)
+			break;
+	}
+}
+
+/*
+ * yfc_apply: Have req applied, either by this thread or by another one
+ * @r: record of the calling thread
+ *
+ * Returns after req->fn has been called.
+ */
+static inline void
+yfc_apply(struct yfc *fc, struct yfc_record *r, struct yfc_request *req){
+	yatomic_store_release(&r->req, req);
+	while(1){
+		int spins = 0;
+		if (!yatomic_load_relaxed(&fc->lock) &&
+		    yatomic_cas(&fc->lock, 0, 1)) {
+			_yfc_combine(fc);
+			yatomic_store_release(&fc->lock, 0);
+			//Ours is always done, since it was published first
+			return;
+		}
+		//Wait for a combiner to do it, or for the lock to be free
+		while(yatomic_load_acquire(&r->req) &&
+		      yatomic_load_relaxed(&fc->lock))
+			if (++spins%YFC_SPINS == 0)
+				thrd_yield();
+		if (!yatomic_load_acquire(&r->req))
+			return;
+	}
+}
+
+/* Operations on a yskiplist */
+struct _yfc_skiplist_op {
+	struct yfc_request req;
+	struct yskiplist_head *h, *n;
+	void *key;
+	yskiplist_cmp cmp;
+};
+
+static inline void _yfc_skiplist_insert(struct yfc_request *req){
+	struct _yfc_skiplist_op *op =
+		container_of(req, struct _yfc_skiplist_op, req);
+	yskiplist_insert(op->h, op->n, op->key, op->cmp);
+}
+
+static inline void _yfc_skiplist_extract(struct yfc_request *req){
+	struct _yfc_skiplist_op *op =
+		container_of(req, struct _yfc_skiplist_op, req);
+	op->n = yskiplist_extract_by_key(op->h, op->key, op->cmp);
+}
+
+static inline void _yfc_skiplist_find_ge(struct yfc_request *req){
+	struct _yfc_skiplist_op *op =
+		container_of(req, struct _yfc_skiplist_op, req);
+	op->n = yskiplist_find_ge(op->h, op->key, op->cmp);
+}
+
+static inline void
+yfc_skiplist_insert(struct yfc *fc, struct yfc_record *r,
+		    struct yskiplist_head *h, struct yskiplist_head *n,
+		    void *key, yskiplist_cmp cmp){
+	struct _yfc_skiplist_op op = {{_yfc_skiplist_insert}, h, n, key, cmp};
+	yfc_apply(fc, r, &op.req);
+}
+
+static inline struct yskiplist_head *
+yfc_skiplist_extract_by_key(struct yfc *fc, struct yfc_record *r,
+			    struct yskiplist_head *h, void *key,
+			    yskiplist_cmp cmp){
+	struct _yfc_skiplist_op op = {{_yfc_skiplist_extract}, h, NULL, key, cmp};
+	yfc_apply(fc, r, &op.req);
+	return op.n;
+}
+
+/*
+ * The node returned can be removed by another thread right away, the
+ * caller has to make sure that doesn't happen.
+ */
+static inline struct yskiplist_head *
+yfc_skiplist_find_ge(struct yfc *fc, struct yfc_record *r,
+		     struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
+	struct _yfc_skiplist_op op = {{_yfc_skiplist_find_ge}, h, NULL, key, cmp};
+	yfc_apply(fc, r, &op.req);
+	return op.n;
+}
+
+/* Operations on a ylist */
+struct _yfc_list_op {
+	struct yfc_request req;
+	struct ylist_head *n, *head;
+};
+
+static inline void _yfc_list_add_tail(struct yfc_request *req){
+	struct _yfc_list_op *op = container_of(req, struct _yfc_list_op, req);
+	ylist_add_tail(op->n, op->head);
+}
+
+static inline void _yfc_list_del(struct yfc_request *req){
+	struct _yfc_list_op *op = container_of(req, struct _yfc_list_op, req);
+	ylist_del(op->n);
+}
+
+static inline void _yfc_list_pop(struct yfc_request *req){
+	struct _yfc_list_op *op = container_of(req, struct _yfc_list_op, req);
+	op->n = NULL;
+	if (!ylist_empty(op->head)) {
+		op->n = op->head->next;
+		ylist_del(op->n);
+	}
+}
+
+static inline void
+yfc_list_add_tail(struct yfc *fc, struct yfc_record *r, struct ylist_head *n,
+		  struct ylist_head *head){
+	struct _yfc_list_op op = {{_yfc_list_add_tail}, n, head};
+	yfc_apply(fc, r, &op.req);
+}
+
+static inline void
+yfc_list_del(struct yfc *fc, struct yfc_record *r, struct ylist_head *n){
+	struct _yfc_list_op op = {{_yfc_list_del}, n, NULL};
+	yfc_apply(fc, r, &op.req);
+}
+
+//Remove and return the first entry of the list, NULL if it's empty.
+static inline struct ylist_head *
+yfc_list_pop(struct yfc *fc, struct yfc_record *r, struct ylist_head *head){
+	struct _yfc_list_op op = {{_yfc_list_pop}, NULL, head};
+	yfc_apply(fc, r, &op.req);
+	return op.n;
+}
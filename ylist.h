@@ -19,6 +19,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <stddef.h>
+
 #include "ydef.h"
 
 /*
@@ -573,3 +575,242 @@ static inline void ylist_splice_tail_init(struct ylist_head *list,
 #define ylist_safe_reset_next(pos, n, member)				\
 	n = ylist_entry(pos->member.next, typeof(*pos), member)
 
+
+/*
+ * Double linked lists with a single pointer list head.
+ * Mostly useful for hash tables where the two pointer list head is
+ * too wasteful.
+ * You lose the ability to access the tail in O(1).
+ */
+
+struct yhlist_node {
+	struct yhlist_node *next, **pprev;
+};
+
+struct yhlist_head {
+	struct yhlist_node *first;
+};
+
+#define YHLIST_HEAD_INIT { .first = NULL }
+#define YHLIST_HEAD(name) struct yhlist_head name = {  .first = NULL }
+#define INIT_YHLIST_HEAD(ptr) ((ptr)->first = NULL)
+static inline void INIT_YHLIST_NODE(struct yhlist_node *h)
+{
+	h->next = NULL;
+	h->pprev = NULL;
+}
+
+/**
+ * yhlist_unhashed - has node been removed from list and reinitialized?
+ * @h: Node to be checked
+ */
+static inline int yhlist_unhashed(const struct yhlist_node *h)
+{
+	return !h->pprev;
+}
+
+/**
+ * yhlist_empty - Is the specified yhlist_head structure an empty yhlist?
+ * @h: Structure to check.
+ */
+static inline int yhlist_empty(const struct yhlist_head *h)
+{
+	return !h->first;
+}
+
+static inline void __yhlist_del(struct yhlist_node *n)
+{
+	struct yhlist_node *next = n->next;
+	struct yhlist_node **pprev = n->pprev;
+
+	*pprev = next;
+	if (next)
+		next->pprev = pprev;
+}
+
+/**
+ * yhlist_del - Delete the specified yhlist_node from its list
+ * @n: Node to delete.
+ *
+ * Note that this function leaves the node in hashed state. Use
+ * yhlist_del_init() or similar instead to unhash @n.
+ */
+static inline void yhlist_del(struct yhlist_node *n)
+{
+	__yhlist_del(n);
+	n->next = (struct yhlist_node *)LIST_POISON1;
+	n->pprev = (struct yhlist_node **)LIST_POISON2;
+}
+
+/**
+ * yhlist_del_init - Delete the specified yhlist_node from its list and
+ * initialize
+ * @n: Node to delete.
+ *
+ * Note that this function leaves the node in unhashed state.
+ */
+static inline void yhlist_del_init(struct yhlist_node *n)
+{
+	if (!yhlist_unhashed(n)) {
+		__yhlist_del(n);
+		INIT_YHLIST_NODE(n);
+	}
+}
+
+/**
+ * yhlist_add_head - add a new entry at the beginning of the yhlist
+ * @n: new entry to be added
+ * @h: yhlist head to add it after
+ *
+ * Insert a new entry after the specified head.
+ * This is good for implementing stacks.
+ */
+static inline void yhlist_add_head(struct yhlist_node *n, struct yhlist_head *h)
+{
+	struct yhlist_node *first = h->first;
+
+	n->next = first;
+	if (first)
+		first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+/**
+ * yhlist_add_before - add a new entry before the one specified
+ * @n: new entry to be added
+ * @next: yhlist node to add it before, which must be non-NULL
+ */
+static inline void yhlist_add_before(struct yhlist_node *n,
+				     struct yhlist_node *next)
+{
+	n->pprev = next->pprev;
+	n->next = next;
+	next->pprev = &n->next;
+	*(n->pprev) = n;
+}
+
+/**
+ * yhlist_add_behind - add a new entry after the one specified
+ * @n: new entry to be added
+ * @prev: yhlist node to add it after, which must be non-NULL
+ */
+static inline void yhlist_add_behind(struct yhlist_node *n,
+				     struct yhlist_node *prev)
+{
+	n->next = prev->next;
+	prev->next = n;
+	n->pprev = &prev->next;
+
+	if (n->next)
+		n->next->pprev = &n->next;
+}
+
+/**
+ * yhlist_add_fake - create a fake yhlist consisting of a single headless node
+ * @n: Node to make a fake list out of
+ *
+ * This makes @n appear to be its own predecessor on a headless yhlist.
+ * The point of this is to allow things like yhlist_del() to work correctly
+ * in cases where there is no list.
+ */
+static inline void yhlist_add_fake(struct yhlist_node *n)
+{
+	n->pprev = &n->next;
+}
+
+/**
+ * yhlist_fake: Is this node a fake yhlist?
+ * @h: Node to check for being a self-referential fake yhlist.
+ */
+static inline int yhlist_fake(struct yhlist_node *h)
+{
+	return h->pprev == &h->next;
+}
+
+/**
+ * yhlist_is_singular_node - is node the only element of the specified yhlist?
+ * @n: Node to check for singularity.
+ * @h: Header for potentially singular list.
+ *
+ * Check whether the node is the only node of the head without
+ * accessing head, thus avoiding unnecessary cache misses.
+ */
+static inline int
+yhlist_is_singular_node(struct yhlist_node *n, struct yhlist_head *h)
+{
+	return !n->next && n->pprev == &h->first;
+}
+
+/**
+ * yhlist_move_list - Move an yhlist
+ * @old: yhlist_head for old list.
+ * @n: yhlist_head for new list.
+ *
+ * Move a list from one list head to another. Fixup the pprev
+ * reference of the first entry if it exists.
+ */
+static inline void yhlist_move_list(struct yhlist_head *old,
+				    struct yhlist_head *n)
+{
+	n->first = old->first;
+	if (n->first)
+		n->first->pprev = &n->first;
+	old->first = NULL;
+}
+
+#define yhlist_entry(ptr, type, member) container_of(ptr,type,member)
+
+#define yhlist_for_each(pos, head) \
+	for (pos = (head)->first; pos ; pos = pos->next)
+
+#define yhlist_for_each_safe(pos, n, head) \
+	for (pos = (head)->first; pos && ({ n = pos->next; 1; }); \
+	     pos = n)
+
+#define yhlist_entry_safe(ptr, type, member) \
+	({ typeof(ptr) ____ptr = (ptr); \
+	   ____ptr ? yhlist_entry(____ptr, type, member) : NULL; \
+	})
+
+/**
+ * yhlist_for_each_entry	- iterate over list of given type
+ * @pos:	the type * to use as a loop cursor.
+ * @head:	the head for your list.
+ * @member:	the name of the yhlist_node within the struct.
+ */
+#define yhlist_for_each_entry(pos, head, member)				\
+	for (pos = yhlist_entry_safe((head)->first, typeof(*(pos)), member);\
+	     pos;							\
+	     pos = yhlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/**
+ * yhlist_for_each_entry_continue - iterate over a yhlist continuing after current point
+ * @pos:	the type * to use as a loop cursor.
+ * @member:	the name of the yhlist_node within the struct.
+ */
+#define yhlist_for_each_entry_continue(pos, member)			\
+	for (pos = yhlist_entry_safe((pos)->member.next, typeof(*(pos)), member);\
+	     pos;							\
+	     pos = yhlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/**
+ * yhlist_for_each_entry_from - iterate over a yhlist continuing from current point
+ * @pos:	the type * to use as a loop cursor.
+ * @member:	the name of the yhlist_node within the struct.
+ */
+#define yhlist_for_each_entry_from(pos, member)				\
+	for (; pos;							\
+	     pos = yhlist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/**
+ * yhlist_for_each_entry_safe - iterate over list of given type safe against removal of list entry
+ * @pos:	the type * to use as a loop cursor.
+ * @n:		another &struct yhlist_node to use as temporary storage
+ * @head:	the head for your list.
+ * @member:	the name of the yhlist_node within the struct.
+ */
+#define yhlist_for_each_entry_safe(pos, n, head, member) 		\
+	for (pos = yhlist_entry_safe((head)->first, typeof(*pos), member);\
+	     pos && ({ n = pos->member.next; 1; });			\
+	     pos = yhlist_entry_safe(n, typeof(*pos), member))
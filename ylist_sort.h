@@ -0,0 +1,322 @@
+#pragma once
+
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Derived from lib/list_sort.c of the Linux kernel, and so licensed under
+ * the GNU General Public License version 2, unlike most of ylib.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Merge sort for ylist.h lists, modeled after list_sort of the Linux kernel.
+ *
+ * ylist_sort() is a bottom-up merge sort done in place: it only relinks
+ * the entries, never allocates, and keeps entries that compare equal in
+ * their original order. ylist_sort_parallel() cuts the list into chunks,
+ * sorts them on separate threads, then merges the chunks pairwise, also
+ * on separate threads.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "ydef.h"
+#include "ylist.h"
+#include "ythread.h"
+
+/*
+ * Returns > 0 if @a should go after @b, <= 0 if @a should stay before @b.
+ * Returning < 0 and 0 have the same effect, so a usual three way compare
+ * function works, and so does a boolean "a > b".
+ */
+typedef int (*ylist_cmp_func)(void *priv, const struct ylist_head *a,
+			      const struct ylist_head *b);
+
+/* Chunks handed to each thread by ylist_sort_parallel() are at least this
+ * long, shorter lists use fewer threads */
+#ifndef YLIST_SORT_MIN_CHUNK
+# define YLIST_SORT_MIN_CHUNK 4096
+#endif
+
+/*
+ * Merge two NULL terminated lists, @a goes first in case of ties. Only the
+ * next pointers are maintained.
+ */
+static inline struct ylist_head *
+_ylist_sort_merge(void *priv, ylist_cmp_func cmp,
+		  struct ylist_head *a, struct ylist_head *b)
+{
+	struct ylist_head *head, **tail = &head;
+
+	for (;;) {
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/*
+ * Merge two non-empty NULL terminated lists, onto @head, restoring the
+ * prev pointers and the circular links along the way.
+ */
+static inline void
+_ylist_sort_merge_final(void *priv, ylist_cmp_func cmp, struct ylist_head *head,
+			struct ylist_head *a, struct ylist_head *b)
+{
+	struct ylist_head *tail = head;
+
+	for (;;) {
+		if (cmp(priv, a, b) <= 0) {
+			tail->next = a;
+			a->prev = tail;
+			tail = a;
+			a = a->next;
+			if (!a)
+				break;
+		} else {
+			tail->next = b;
+			b->prev = tail;
+			tail = b;
+			b = b->next;
+			if (!b) {
+				b = a;
+				break;
+			}
+		}
+	}
+
+	//What's left of the other list is already sorted
+	tail->next = b;
+	do {
+		b->prev = tail;
+		tail = b;
+		b = b->next;
+	} while (b);
+
+	tail->next = head;
+	head->prev = tail;
+}
+
+/**
+ * ylist_sort - sort a list
+ * @priv:	private data, passed to @cmp
+ * @head:	the list to sort
+ * @cmp:	the elements comparison function
+ *
+ * The sort is stable, and takes O(n log n) comparisons and O(1) extra
+ * space.
+ *
+ * Sorted sublists are kept on a pending list, linked through their prev
+ * pointers, with their sizes being distinct powers of two, except that
+ * each size can appear twice. When a third sublist of a size would be
+ * added, the two older ones are merged first. This keeps merges balanced
+ * at 2:1 at worst, which is as good as a top-down merge sort, while only
+ * ever looking at a few sublists that are likely still in cache.
+ */
+static inline void ylist_sort(void *priv, struct ylist_head *head,
+			      ylist_cmp_func cmp)
+{
+	struct ylist_head *list = head->next, *pending = NULL;
+	size_t count = 0;	/* Count of pending */
+
+	if (list == head->prev)	/* Zero or one elements */
+		return;
+
+	/* Convert to a NULL terminated singly linked list */
+	head->prev->next = NULL;
+
+	do {
+		size_t bits;
+		struct ylist_head **tail = &pending;
+
+		/*
+		 * Find the least significant clear bit in count, the
+		 * sublists below it are single copies of their size, the
+		 * two at that position are merged.
+		 */
+		for (bits = count; bits & 1; bits >>= 1)
+			tail = &(*tail)->prev;
+		if (bits) {
+			struct ylist_head *a = *tail, *b = a->prev;
+
+			a = _ylist_sort_merge(priv, cmp, b, a);
+			a->prev = b->prev;
+			*tail = a;
+		}
+
+		/* Move one element from the input to pending */
+		list->prev = pending;
+		pending = list;
+		list = list->next;
+		pending->next = NULL;
+		count++;
+	} while (list);
+
+	/* Merge all the pending lists, newest first */
+	list = pending;
+	pending = pending->prev;
+	for (;;) {
+		struct ylist_head *next = pending->prev;
+
+		if (!next)
+			break;
+		list = _ylist_sort_merge(priv, cmp, pending, list);
+		pending = next;
+	}
+	_ylist_sort_merge_final(priv, cmp, head, pending, list);
+}
+
+/*
+ * Merge the sorted list @other into the sorted list @head, entries of
+ * @head go first in case of ties. @other is left empty.
+ */
+static inline void _ylist_sort_merge_lists(void *priv, ylist_cmp_func cmp,
+					   struct ylist_head *head,
+					   struct ylist_head *other)
+{
+	struct ylist_head *a, *b;
+
+	if (ylist_empty(other))
+		return;
+	if (ylist_empty(head)) {
+		ylist_splice_init(other, head);
+		return;
+	}
+	a = head->next;
+	head->prev->next = NULL;
+	b = other->next;
+	other->prev->next = NULL;
+	INIT_YLIST_HEAD(other);
+	_ylist_sort_merge_final(priv, cmp, head, a, b);
+}
+
+struct _ylist_sort_job {
+	struct ylist_head head;
+	/* Merged into head if not NULL, otherwise head is sorted */
+	struct ylist_head *other;
+	void *priv;
+	ylist_cmp_func cmp;
+	thrd_t thrd;
+	bool started;
+};
+
+static inline int _ylist_sort_worker(void *arg)
+{
+	struct _ylist_sort_job *j = arg;
+
+	if (j->other)
+		_ylist_sort_merge_lists(j->priv, j->cmp, &j->head, j->other);
+	else
+		ylist_sort(j->priv, &j->head, j->cmp);
+	return 0;
+}
+
+/*
+ * Run every @stride-th job starting from 0, on their own threads, except
+ * for the last one, which is run by the caller. Jobs whose thread can't be
+ * created are run by the caller too.
+ */
+static inline void _ylist_sort_run(struct _ylist_sort_job *jobs, int njobs,
+				   int stride)
+{
+	int i, last = (njobs-1)/stride*stride;
+
+	for (i = 0; i < last; i += stride)
+		jobs[i].started = thrd_create(&jobs[i].thrd, _ylist_sort_worker,
+					      &jobs[i]) == thrd_success;
+	for (i = 0; i <= last; i += stride) {
+		if (i == last || !jobs[i].started)
+			_ylist_sort_worker(&jobs[i]);
+	}
+	for (i = 0; i < last; i += stride) {
+		if (jobs[i].started)
+			thrd_join(jobs[i].thrd, NULL);
+	}
+}
+
+/**
+ * ylist_sort_parallel - sort a list using several threads
+ * @priv:	private data, passed to @cmp
+ * @head:	the list to sort
+ * @cmp:	the elements comparison function, called from several
+ *		threads at the same time
+ * @nthreads:	the maximum number of threads to use, including the caller
+ *
+ * The result is the same as ylist_sort(), it's stable too. Each thread gets
+ * at least YLIST_SORT_MIN_CHUNK entries. If memory for the bookkeeping
+ * can't be allocated, the list is sorted with ylist_sort() instead.
+ */
+static inline void ylist_sort_parallel(void *priv, struct ylist_head *head,
+				       ylist_cmp_func cmp, int nthreads)
+{
+	struct _ylist_sort_job *jobs;
+	struct ylist_head *pos, empty;
+	size_t n = 0, chunk;
+	int i, step;
+
+	ylist_for_each(pos, head)
+		n++;
+	if (nthreads > 1 && n/YLIST_SORT_MIN_CHUNK < (size_t)nthreads)
+		nthreads = n/YLIST_SORT_MIN_CHUNK;
+	if (nthreads <= 1 || !(jobs = talloc(nthreads, struct _ylist_sort_job))) {
+		ylist_sort(priv, head, cmp);
+		return;
+	}
+
+	/* Cut the list into chunks, the last one takes the remainder */
+	chunk = n/nthreads;
+	for (i = 0; i < nthreads; i++) {
+		size_t k;
+
+		INIT_YLIST_HEAD(&jobs[i].head);
+		jobs[i].other = NULL;
+		jobs[i].priv = priv;
+		jobs[i].cmp = cmp;
+		if (i == nthreads-1) {
+			ylist_splice_init(head, &jobs[i].head);
+			break;
+		}
+		pos = head;
+		for (k = 0; k < chunk; k++)
+			pos = pos->next;
+		ylist_cut_position(&jobs[i].head, head, pos);
+	}
+	_ylist_sort_run(jobs, nthreads, 1);
+
+	/* Merge neighbouring chunks, so earlier entries stay first on ties.
+	 * A chunk without a neighbour is merged with an empty list */
+	INIT_YLIST_HEAD(&empty);
+	for (step = 1; step < nthreads; step *= 2) {
+		for (i = 0; i < nthreads; i += 2*step)
+			jobs[i].other = i+step < nthreads ? &jobs[i+step].head : &empty;
+		_ylist_sort_run(jobs, nthreads, 2*step);
+	}
+
+	ylist_splice_init(&jobs[0].head, head);
+	free(jobs);
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Derived from include/linux/llist.h of the Linux kernel,
+ * Copyright 2010,2011 Intel Corp.
+ *   Author: Huang Ying <ying.huang@intel.com>
+ * and so licensed under the GNU General Public License version 2, unlike
+ * most of ylib.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Lock-less singly linked list, modeled after llist.h of the Linux kernel.
+ *
+ * Any number of threads can add entries at the same time, with
+ * yllist_add() or yllist_add_batch(). Entries are taken out all at once
+ * with yllist_del_all(), which can be called concurrently with adders and
+ * with other yllist_del_all() callers. The list is a stack, so the
+ * entries come out newest first; yllist_reverse_order() restores the order
+ * they were added in.
+ *
+ * yllist_del_first() takes out a single entry. Because of the ABA problem,
+ * it can't be called concurrently with another yllist_del_first(), but it
+ * can with adders and yllist_del_all().
+ *
+ * Walking the list is only safe on a chain that was taken out of it.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ydef.h"
+#include "yatomic.h"
+
+struct yllist_head {
+	struct yllist_node *first;
+};
+
+struct yllist_node {
+	struct yllist_node *next;
+};
+
+#define YLLIST_HEAD_INIT(name)	{ NULL }
+#define YLLIST_HEAD(name)	struct yllist_head name = YLLIST_HEAD_INIT(name)
+
+/**
+ * init_yllist_head - initialize lock-less list head
+ * @list:	the head for your lock-less list
+ */
+static inline void init_yllist_head(struct yllist_head *list)
+{
+	list->first = NULL;
+}
+
+/**
+ * yllist_entry - get the struct of this entry
+ * @ptr:	the &struct yllist_node pointer.
+ * @type:	the type of the struct this is embedded in.
+ * @member:	the name of the yllist_node within the struct.
+ */
+#define yllist_entry(ptr, type, member) \
+	container_of(ptr, type, member)
+
+/**
+ * yllist_entry_safe - get the struct of this entry, or NULL
+ * @ptr:	the &struct yllist_node pointer, can be NULL.
+ * @type:	the type of the struct this is embedded in.
+ * @member:	the name of the yllist_node within the struct.
+ */
+#define yllist_entry_safe(ptr, type, member) ({				\
+	typeof(ptr) ____ptr = (ptr);					\
+	____ptr ? yllist_entry(____ptr, type, member) : NULL;		\
+})
+
+/**
+ * yllist_for_each - iterate over some deleted entries of a lock-less list
+ * @pos:	the &struct yllist_node to use as a loop cursor
+ * @node:	the first entry of deleted list entries
+ *
+ * In general, some entries of the lock-less list can be traversed
+ * safely only after being deleted from list, so start with an entry
+ * instead of list head.
+ */
+#define yllist_for_each(pos, node) \
+	for ((pos) = (node); pos; (pos) = (pos)->next)
+
+/**
+ * yllist_for_each_safe - iterate over some deleted entries, safe against
+ *			  removal of list entry
+ * @pos:	the &struct yllist_node to use as a loop cursor
+ * @n:		another &struct yllist_node to use as temporary storage
+ * @node:	the first entry of deleted list entries
+ */
+#define yllist_for_each_safe(pos, n, node) \
+	for ((pos) = (node); (pos) && ((n) = (pos)->next, true); (pos) = (n))
+
+/**
+ * yllist_for_each_entry - iterate over some deleted entries of lock-less
+ *			   list of given type
+ * @pos:	the type * to use as a loop cursor.
+ * @node:	the first entry of deleted list entries.
+ * @member:	the name of the yllist_node within the struct.
+ */
+#define yllist_for_each_entry(pos, node, member)				\
+	for ((pos) = yllist_entry_safe((node), typeof(*(pos)), member);	\
+	     pos;								\
+	     (pos) = yllist_entry_safe((pos)->member.next, typeof(*(pos)), member))
+
+/**
+ * yllist_for_each_entry_safe - iterate over some deleted entries of
+ *				lock-less list of given type, safe against
+ *				removal of list entry
+ * @pos:	the type * to use as a loop cursor.
+ * @n:		another type * to use as temporary storage
+ * @node:	the first entry of deleted list entries.
+ * @member:	the name of the yllist_node within the struct.
+ *
+ * The entries can be freed in the loop body.
+ */
+#define yllist_for_each_entry_safe(pos, n, node, member)			\
+	for (pos = yllist_entry_safe((node), typeof(*pos), member);		\
+	     pos && (n = yllist_entry_safe(pos->member.next,			\
+					   typeof(*pos), member), true);	\
+	     pos = n)
+
+/**
+ * yllist_empty - tests whether a lock-less list is empty
+ * @head:	the list to test
+ *
+ * Not guaranteed to be accurate or up to date. Just a quick way to
+ * test whether the list is empty without deleting something from the
+ * list.
+ */
+static inline bool yllist_empty(const struct yllist_head *head)
+{
+	return yatomic_load_relaxed(&head->first) == NULL;
+}
+
+static inline struct yllist_node *yllist_next(struct yllist_node *node)
+{
+	return node->next;
+}
+
+/**
+ * yllist_add_batch - add several linked entries in batch
+ * @new_first:	first entry in batch to be added
+ * @new_last:	last entry in batch to be added
+ * @head:	the head for your lock-less list
+ *
+ * Return whether list is empty before adding.
+ */
+static inline bool yllist_add_batch(struct yllist_node *new_first,
+				    struct yllist_node *new_last,
+				    struct yllist_head *head)
+{
+	struct yllist_node *first = yatomic_load_relaxed(&head->first);
+
+	do {
+		new_last->next = first;
+	} while (!__atomic_compare_exchange_n(&head->first, &first, new_first,
+					      true, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	return first == NULL;
+}
+
+/**
+ * yllist_add - add a new entry
+ * @new:	new entry to be added
+ * @head:	the head for your lock-less list
+ *
+ * Returns true if the list was empty prior to adding this entry.
+ */
+static inline bool yllist_add(struct yllist_node *new, struct yllist_head *head)
+{
+	return yllist_add_batch(new, new, head);
+}
+
+/**
+ * yllist_del_all - delete all entries from lock-less list
+ * @head:	the head of lock-less list to delete all entries
+ *
+ * If list is empty, return NULL, otherwise, delete all entries and
+ * return the pointer to the first entry. The order of entries
+ * deleted is from the newest to the oldest added one.
+ */
+static inline struct yllist_node *yllist_del_all(struct yllist_head *head)
+{
+	return yatomic_xchg(&head->first, NULL);
+}
+
+/**
+ * yllist_del_first - delete the first entry of lock-less list
+ * @head:	the head for your lock-less list
+ *
+ * If list is empty, return NULL, otherwise, return the first entry
+ * deleted, this is the newest added one.
+ *
+ * Only one yllist_del_first() may run at a time, see the top of this file.
+ */
+static inline struct yllist_node *yllist_del_first(struct yllist_head *head)
+{
+	struct yllist_node *entry = yatomic_load_acquire(&head->first), *next;
+
+	do {
+		if (entry == NULL)
+			return NULL;
+		next = yatomic_load_relaxed(&entry->next);
+	} while (!__atomic_compare_exchange_n(&head->first, &entry, next,
+					      true, __ATOMIC_ACQUIRE,
+					      __ATOMIC_ACQUIRE));
+
+	return entry;
+}
+
+/**
+ * yllist_reverse_order - reverse order of a yllist chain
+ * @head:	first item of the list to be reversed
+ *
+ * Reverse the order of a chain of yllist entries, in place, and return
+ * the pointer to the new first entry. Used after yllist_del_all() to get
+ * the entries in the order they were added.
+ */
+static inline struct yllist_node *yllist_reverse_order(struct yllist_node *head)
+{
+	struct yllist_node *new_head = NULL;
+
+	while (head) {
+		struct yllist_node *tmp = head;
+		head = head->next;
+		tmp->next = new_head;
+		new_head = tmp;
+	}
+
+	return new_head;
+}
@@ -0,0 +1,112 @@
+/* A lock-free multi-producer single-consumer queue.
+ *
+ * This is Dmitry Vyukov's intrusive MPSC queue. struct ympsc_node is
+ * embedded in the queued structs, like struct ylist_head. Pushing takes one
+ * atomic exchange and never waits, popping is wait-free too, but only one
+ * thread may pop at a time.
+ *
+ * Producers link the new node to the queue right after the exchange. If
+ * a producer is stopped in between, the consumer can't see past the node
+ * that producer was adding, and ympsc_pop() returns NULL until the link is
+ * made, even though there are nodes in the queue.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "ydef.h"
+#include "yatomic.h"
+
+struct ympsc_node {
+	struct ympsc_node *next;
+};
+
+struct ympsc {
+	/* Producers add nodes here */
+	struct ympsc_node *head;
+	/* The consumer takes nodes from here */
+	struct ympsc_node *tail;
+	/* Kept in the queue, so it's never empty */
+	struct ympsc_node stub;
+};
+
+#define ympsc_entry(ptr, type, member) \
+	container_of(ptr, type, member)
+
+static inline void ympsc_init(struct ympsc *q){
+	q->stub.next = NULL;
+	q->head = q->tail = &q->stub;
+}
+
+//Add n to the queue, can be called from any thread.
+static inline void ympsc_push(struct ympsc *q, struct ympsc_node *n){
+	struct ympsc_node *prev;
+	yatomic_store_relaxed(&n->next, NULL);
+	prev = yatomic_xchg(&q->head, n);
+	yatomic_store_release(&prev->next, n);
+}
+
+/*
+ * ympsc_pop: Take the oldest node from the queue
+ * @return: the node, or NULL if the queue is empty, or a push is not
+ * finished yet.
+ *
+ * Only one thread may pop from a queue at a time.
+ */
+static inline struct ympsc_node *ympsc_pop(struct ympsc *q){
+	struct ympsc_node *tail = q->tail,
+			  *next = yatomic_load_acquire(&tail->next);
+	if (tail == &q->stub) {
+		if (!next)
+			return NULL;
+		q->tail = tail = next;
+		next = yatomic_load_acquire(&next->next);
+	}
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+
+	//tail is the last node, unless a push is half way done
+	if (tail != yatomic_load_acquire(&q->head))
+		return NULL;
+	//Put stub back behind tail, so tail can be taken out
+	ympsc_push(q, &q->stub);
+	next = yatomic_load_acquire(&tail->next);
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/*
+ * ympsc_pop_all: Take all nodes that are in the queue
+ * @return: the nodes, oldest first, linked through their next pointers
+ * and terminated by NULL.
+ *
+ * Nodes pushed after the call starts are left in the queue, so this
+ * returns even if producers never stop. Like ympsc_pop(), it can stop
+ * short at a push that's not finished yet. Only one thread may pop from a
+ * queue at a time.
+ */
+static inline struct ympsc_node *ympsc_pop_all(struct ympsc *q){
+	struct ympsc_node *first = NULL, **tail = &first, *n,
+			  *last = yatomic_load_acquire(&q->head);
+	while(1){
+		//Reached stub, which was the last node when the call started
+		if (last == &q->stub && q->tail == &q->stub)
+			break;
+		n = ympsc_pop(q);
+		if (!n)
+			break;
+		//Once popped, nothing else writes to n->next
+		*tail = n;
+		tail = &n->next;
+		if (n == last)
+			break;
+	}
+	*tail = NULL;
+	return first;
+}
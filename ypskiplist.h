@@ -0,0 +1,362 @@
+/* A persistent skiplist, stored in a memory mapped file.
+ *
+ * Nodes link to each other with offsets from the start of the file
+ * instead of pointers, so the file can be mapped anywhere, and opening it
+ * again needs no rebuilding. Keys and values have fixed sizes, chosen when
+ * the file is created, and keys are ordered by memcmp().
+ *
+ * Updates are ordered so the file is always a valid list: a node is only
+ * linked on level 0 after it's fully written, and level 0 is what decides
+ * whether a node is in the list. Upper levels are only shortcuts, so it
+ * doesn't matter if a crash leaves a node missing from some of them. For
+ * the same reason, deletion unlinks a node from level 0 last.
+ *
+ * The mapping is shared, so a process crash never loses anything. To also
+ * survive the system going down, open the file with YPSKIPLIST_DURABLE,
+ * which flushes the file with msync() at each of these ordering points.
+ *
+ * Accesses from several threads or processes must be serialized by the
+ * caller. Pointers to nodes are only valid until the next insertion,
+ * which can remap the file.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "yatomic.h"
+#include "yskiplist.h"
+
+#define YPSKIPLIST_MAGIC 0x7970736b69706c31ULL
+/* Bumped whenever the layout of the file changes */
+#define YPSKIPLIST_VERSION 2
+
+/* msync() the file at every ordering point */
+#define YPSKIPLIST_DURABLE 1
+
+struct ypskiplist_node {
+	uint32_t h, pad;
+	/* Offsets of the next nodes, 0 for none. Followed by the key and
+	 * the value, both padded to 8 bytes. */
+	uint64_t next[];
+};
+
+struct _ypskiplist_hdr {
+	uint64_t magic;
+	/* The layout depends on MAX_HEIGHT, so it's recorded too */
+	uint32_t version, height;
+	uint32_t ksize, vsize;
+	/* End of the allocated part of the file */
+	uint64_t used;
+	/* Deleted nodes of each height, linked through next[0] */
+	uint64_t free[MAX_HEIGHT];
+	/* Number of levels in use, and the links of the head, which isn't
+	 * a node. Offset 0 stands for the head. */
+	uint32_t level, pad;
+	uint64_t head_next[MAX_HEIGHT];
+};
+
+struct ypskiplist {
+	int fd, flags;
+	char *base;
+	size_t size;
+};
+
+#define _ypskiplist_hdr(l) ((struct _ypskiplist_hdr *)(l)->base)
+#define _ypskiplist_node(l, off) \
+	((struct ypskiplist_node *)((l)->base+(off)))
+#define _ypskiplist_off(l, n) ((uint64_t)((char *)(n)-(l)->base))
+#define _ypskiplist_pad(x) (((size_t)(x)+7)&~(size_t)7)
+
+#define ypskiplist_key(n) ((void *)((n)->next+(n)->h))
+#define ypskiplist_val(l, n) \
+	((void *)((char *)ypskiplist_key(n)+				\
+		  _ypskiplist_pad(_ypskiplist_hdr(l)->ksize)))
+
+//Links of the node at off, or of the head if off is 0
+static inline uint64_t *_ypskiplist_next(struct ypskiplist *l, uint64_t off){
+	return off ? _ypskiplist_node(l, off)->next : _ypskiplist_hdr(l)->head_next;
+}
+
+static inline size_t _ypskiplist_node_size(struct ypskiplist *l, int h){
+	struct _ypskiplist_hdr *hdr = _ypskiplist_hdr(l);
+	return sizeof(struct ypskiplist_node)+h*sizeof(uint64_t)+
+	       _ypskiplist_pad(hdr->ksize)+_ypskiplist_pad(hdr->vsize);
+}
+
+//Make [p, p+len) durable, if asked to.
+static inline int _ypskiplist_persist(struct ypskiplist *l, void *p, size_t len){
+	uintptr_t pg = sysconf(_SC_PAGESIZE);
+	uintptr_t s = (uintptr_t)p&~(pg-1);
+	if (!(l->flags&YPSKIPLIST_DURABLE))
+		return 0;
+	return msync((void *)s, (uintptr_t)p+len-s, MS_SYNC);
+}
+
+//Map the first size bytes of the file, replacing the old mapping if any.
+static inline int _ypskiplist_map(struct ypskiplist *l, size_t size){
+	void *p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, l->fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	if (l->base)
+		munmap(l->base, l->size);
+	l->base = p;
+	l->size = size;
+	return 0;
+}
+
+/*
+ * ypskiplist_open: Open a list file, creating it if it doesn't exist
+ * @ksize, @vsize: sizes of keys and values, must match the ones the file
+ *		   was created with
+ * @flags: YPSKIPLIST_* flags
+ * @return: 0 on success, -1 on error, with errno set
+ *
+ * Only an empty file is initialized. Fails with EINVAL if the file isn't a
+ * list, was made with a different MAX_HEIGHT or version of this header, or
+ * if its creation was interrupted.
+ */
+static inline int
+ypskiplist_open(struct ypskiplist *l, const char *path, uint32_t ksize,
+		uint32_t vsize, int flags){
+	struct _ypskiplist_hdr *hdr;
+	struct stat st;
+	bool created = false;
+	int i;
+	l->flags = flags;
+	l->base = NULL;
+	l->fd = open(path, O_RDWR|O_CREAT, 0644);
+	if (l->fd < 0)
+		return -1;
+	if (fstat(l->fd, &st) < 0)
+		goto err;
+	if (st.st_size == 0) {
+		created = true;
+		st.st_size = 1<<20;
+		if (ftruncate(l->fd, st.st_size) < 0)
+			goto err;
+	}
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		errno = EINVAL;
+		goto err;
+	}
+	if (_ypskiplist_map(l, st.st_size) < 0)
+		goto err;
+
+	hdr = _ypskiplist_hdr(l);
+	if (created) {
+		//The magic number goes last
+		hdr->version = YPSKIPLIST_VERSION;
+		hdr->height = MAX_HEIGHT;
+		hdr->ksize = ksize;
+		hdr->vsize = vsize;
+		hdr->used = _ypskiplist_pad(sizeof(*hdr));
+		hdr->level = 1;
+		if (_ypskiplist_persist(l, hdr, sizeof(*hdr)) < 0)
+			goto err_unmap;
+		hdr->magic = YPSKIPLIST_MAGIC;
+		if (_ypskiplist_persist(l, hdr, sizeof(*hdr)) < 0)
+			goto err_unmap;
+	} else if (hdr->magic != YPSKIPLIST_MAGIC ||
+		   hdr->version != YPSKIPLIST_VERSION ||
+		   hdr->height != MAX_HEIGHT || hdr->ksize != ksize ||
+		   hdr->vsize != vsize || hdr->used > l->size) {
+		errno = EINVAL;
+		goto err_unmap;
+	}
+
+	//The level isn't kept in order with the links, recompute it
+	for(i = MAX_HEIGHT; i > 1 && !hdr->head_next[i-1]; i--);
+	hdr->level = i;
+	return 0;
+
+err_unmap:
+	munmap(l->base, l->size);
+err:
+	close(l->fd);
+	return -1;
+}
+
+static inline int ypskiplist_sync(struct ypskiplist *l){
+	return msync(l->base, l->size, MS_SYNC);
+}
+
+static inline void ypskiplist_close(struct ypskiplist *l){
+	munmap(l->base, l->size);
+	close(l->fd);
+}
+
+/*
+ * Allocate a node of height h, from the free list, or from the end of the
+ * file, which is grown if needed.
+ * @return: offset of the node, 0 on error
+ */
+static inline uint64_t _ypskiplist_alloc(struct ypskiplist *l, int h){
+	struct _ypskiplist_hdr *hdr = _ypskiplist_hdr(l);
+	size_t sz = _ypskiplist_node_size(l, h);
+	uint64_t off = hdr->free[h-1];
+	if (off) {
+		hdr->free[h-1] = _ypskiplist_node(l, off)->next[0];
+	} else {
+		if (hdr->used+sz > l->size) {
+			size_t nsize = l->size*2;
+			while(hdr->used+sz > nsize)
+				nsize *= 2;
+			if (ftruncate(l->fd, nsize) < 0 ||
+			    _ypskiplist_map(l, nsize) < 0)
+				return 0;
+			hdr = _ypskiplist_hdr(l);
+		}
+		off = hdr->used;
+		hdr->used += sz;
+	}
+	//The space must be taken before anything links to it
+	if (_ypskiplist_persist(l, hdr, sizeof(*hdr)) < 0)
+		return 0;
+	return off;
+}
+
+/*
+ * Find the last node less than key on every level, as offsets, 0 for the
+ * head.
+ * @return: whether the node after preds[0] is equal to key
+ */
+static inline bool
+_ypskiplist_previous(struct ypskiplist *l, const void *key, uint64_t *preds){
+	struct _ypskiplist_hdr *hdr = _ypskiplist_hdr(l);
+	size_t ksize = hdr->ksize;
+	uint64_t x = 0, nx = 0;
+	int i;
+	for(i = MAX_HEIGHT-1; i >= (int)hdr->level; i--)
+		preds[i] = 0;
+	for(i = hdr->level-1; i >= 0; i--){
+		while((nx = yatomic_load_acquire(&_ypskiplist_next(l, x)[i])) &&
+		      memcmp(ypskiplist_key(_ypskiplist_node(l, nx)), key,
+			     ksize) < 0)
+			x = nx;
+		preds[i] = x;
+	}
+	return nx && memcmp(ypskiplist_key(_ypskiplist_node(l, nx)), key,
+			    ksize) == 0;
+}
+
+/*
+ * ypskiplist_insert: Insert a key with its value
+ * @return: 0 on success, 1 if the key is already in the list, -1 on error
+ */
+static inline int
+ypskiplist_insert(struct ypskiplist *l, const void *key, const void *val){
+	uint64_t preds[MAX_HEIGHT], off;
+	struct _ypskiplist_hdr *hdr;
+	struct ypskiplist_node *n;
+	int h = yskiplist_gen_height(), i;
+
+	if (_ypskiplist_previous(l, key, preds))
+		return 1;
+	off = _ypskiplist_alloc(l, h);
+	if (!off)
+		return -1;
+	hdr = _ypskiplist_hdr(l);
+	n = _ypskiplist_node(l, off);
+	n->h = h;
+	n->pad = 0;
+	for(i = 0; i < h; i++)
+		n->next[i] = _ypskiplist_next(l, preds[i])[i];
+	memcpy(ypskiplist_key(n), key, hdr->ksize);
+	memcpy(ypskiplist_val(l, n), val, hdr->vsize);
+	if (_ypskiplist_persist(l, n, _ypskiplist_node_size(l, h)) < 0)
+		return -1;
+
+	//Linking on level 0 commits the insertion
+	for(i = 0; i < h; i++){
+		uint64_t *p = &_ypskiplist_next(l, preds[i])[i];
+		yatomic_store_release(p, off);
+		if (i == 0 && _ypskiplist_persist(l, p, sizeof(*p)) < 0)
+			return -1;
+	}
+	if ((uint32_t)h > hdr->level)
+		hdr->level = h;
+	return 0;
+}
+
+/*
+ * ypskiplist_delete: Remove a key
+ * @return: 1 if removed, 0 if not found, -1 on error
+ */
+static inline int ypskiplist_delete(struct ypskiplist *l, const void *key){
+	uint64_t preds[MAX_HEIGHT], off, *p;
+	struct _ypskiplist_hdr *hdr = _ypskiplist_hdr(l);
+	struct ypskiplist_node *n;
+	int i;
+
+	if (!_ypskiplist_previous(l, key, preds))
+		return 0;
+	off = _ypskiplist_next(l, preds[0])[0];
+	n = _ypskiplist_node(l, off);
+	for(i = n->h-1; i > 0; i--){
+		p = &_ypskiplist_next(l, preds[i])[i];
+		//A crash during insertion can leave n off some upper levels
+		if (*p != off)
+			continue;
+		yatomic_store_release(p, n->next[i]);
+		if (_ypskiplist_persist(l, p, sizeof(*p)) < 0)
+			return -1;
+	}
+	//Unlinking from level 0 commits the deletion
+	p = &_ypskiplist_next(l, preds[0])[0];
+	yatomic_store_release(p, n->next[0]);
+	if (_ypskiplist_persist(l, p, sizeof(*p)) < 0)
+		return -1;
+
+	/* The free list link has to be on the disk before the node is put on
+	 * the free list, otherwise it could still point to a live node. If
+	 * only the header update is lost, the node is leaked. */
+	n->next[0] = hdr->free[n->h-1];
+	if (_ypskiplist_persist(l, &n->next[0], sizeof(n->next[0])) < 0)
+		return -1;
+	hdr->free[n->h-1] = off;
+	if (_ypskiplist_persist(l, &hdr->free[n->h-1], sizeof(uint64_t)) < 0)
+		return -1;
+	while(hdr->level > 1 && !hdr->head_next[hdr->level-1])
+		hdr->level--;
+	return 1;
+}
+
+//Find the smallest key that is greater than or equal to key.
+static inline struct ypskiplist_node *
+ypskiplist_find_ge(struct ypskiplist *l, const void *key){
+	uint64_t preds[MAX_HEIGHT], off;
+	_ypskiplist_previous(l, key, preds);
+	off = yatomic_load_acquire(&_ypskiplist_next(l, preds[0])[0]);
+	return off ? _ypskiplist_node(l, off) : NULL;
+}
+
+//Find the largest key that is less than or equal to key.
+static inline struct ypskiplist_node *
+ypskiplist_find_le(struct ypskiplist *l, const void *key){
+	uint64_t preds[MAX_HEIGHT];
+	if (_ypskiplist_previous(l, key, preds))
+		return _ypskiplist_node(l, _ypskiplist_next(l, preds[0])[0]);
+	if (!preds[0])
+		return NULL;
+	return _ypskiplist_node(l, preds[0]);
+}
+
+static inline struct ypskiplist_node *ypskiplist_first(struct ypskiplist *l){
+	uint64_t off = yatomic_load_acquire(&_ypskiplist_hdr(l)->head_next[0]);
+	return off ? _ypskiplist_node(l, off) : NULL;
+}
+
+static inline struct ypskiplist_node *
+ypskiplist_next(struct ypskiplist *l, struct ypskiplist_node *n){
+	uint64_t off = yatomic_load_acquire(&n->next[0]);
+	return off ? _ypskiplist_node(l, off) : NULL;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+/*
+ * SPDX-License-Identifier: GPL-2.0
+ *
+ * Derived from include/linux/rculist.h of the Linux kernel, and so
+ * licensed under the GNU General Public License version 2, unlike most
+ * of ylib.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * RCU variants of the ylist.h operations, modeled after rculist.h of the
+ * Linux kernel.
+ *
+ * Writers still have to be serialized, e.g. with a mutex, but readers take
+ * no lock: they iterate with ylist_for_each_entry_rcu() inside a yepoch.h
+ * critical section (yepoch_enter()/yepoch_exit()), concurrently with the
+ * writers. Entries are published with release stores, so a reader that
+ * finds an entry sees it fully initialized. A deleted entry keeps its
+ * forward pointer, so readers standing on it can carry on, and must only
+ * be freed after a grace period, by yepoch_retire() or after
+ * yepoch_synchronize().
+ *
+ * Readers only follow the next pointers, walking backwards is not safe.
+ */
+
+#include "ydef.h"
+#include "yatomic.h"
+#include "yepoch.h"
+#include "ylist.h"
+
+/*
+ * Where readers pick up a pointer to follow, and where writers publish
+ * one. The latter orders the initialization of the entry before it.
+ */
+#define ylist_next_rcu(list)	(yatomic_load_acquire(&(list)->next))
+#define _ylist_assign_next_rcu(list, n) \
+	yatomic_store_release(&(list)->next, (n))
+
+/*
+ * INIT_YLIST_HEAD_RCU - initialize a list head visible to readers
+ * @list: list to be initialized
+ */
+static inline void INIT_YLIST_HEAD_RCU(struct ylist_head *list)
+{
+	yatomic_store_relaxed(&list->next, list);
+	list->prev = list;
+}
+
+/*
+ * Insert a new entry between two known consecutive entries.
+ *
+ * This is only for internal list manipulation where we know
+ * the prev/next entries already!
+ */
+static inline void __list_add_rcu(struct ylist_head *n,
+				  struct ylist_head *prev,
+				  struct ylist_head *next)
+{
+	n->next = next;
+	n->prev = prev;
+	_ylist_assign_next_rcu(prev, n);
+	next->prev = n;
+}
+
+/**
+ * ylist_add_rcu - add a new entry to rcu-protected list
+ * @n: new entry to be added
+ * @head: list head to add it after
+ *
+ * Insert a new entry after the specified head. The caller must hold the
+ * lock writers use, but it's fine to run this concurrently with readers
+ * in ylist_for_each_entry_rcu().
+ */
+static inline void ylist_add_rcu(struct ylist_head *n, struct ylist_head *head)
+{
+	__list_add_rcu(n, head, head->next);
+}
+
+/**
+ * ylist_add_tail_rcu - add a new entry to rcu-protected list
+ * @n: new entry to be added
+ * @head: list head to add it before
+ *
+ * Insert a new entry before the specified head, same rules as
+ * ylist_add_rcu().
+ */
+static inline void ylist_add_tail_rcu(struct ylist_head *n,
+				      struct ylist_head *head)
+{
+	__list_add_rcu(n, head->prev, head);
+}
+
+/**
+ * ylist_del_rcu - deletes entry from list without re-initialization
+ * @entry: the element to delete from the list.
+ *
+ * Note: ylist_empty() on entry does not return true after this, the entry
+ * is in an undefined state. The next pointer is left alone, since readers
+ * may still be traversing the entry, but the prev pointer is poisoned.
+ *
+ * The entry can only be freed after a grace period, e.g.:
+ *
+ *	ylist_del_rcu(&p->list);
+ *	yepoch_retire(t, &p->epoch, free_p);
+ */
+static inline void ylist_del_rcu(struct ylist_head *entry)
+{
+	struct ylist_head *prev = entry->prev, *next = entry->next;
+
+	next->prev = prev;
+	_ylist_assign_next_rcu(prev, next);
+	entry->prev = (struct ylist_head *)LIST_POISON2;
+}
+
+/**
+ * ylist_replace_rcu - replace old entry by new one
+ * @old : the element to be replaced
+ * @n : the new element to insert
+ *
+ * Readers see either @old or @n, never neither. @old can only be freed
+ * after a grace period.
+ */
+static inline void ylist_replace_rcu(struct ylist_head *old,
+				     struct ylist_head *n)
+{
+	n->next = old->next;
+	n->prev = old->prev;
+	_ylist_assign_next_rcu(n->prev, n);
+	n->next->prev = n;
+	old->prev = (struct ylist_head *)LIST_POISON2;
+}
+
+/**
+ * ylist_entry_rcu - get the struct for this entry
+ * @ptr:	the &struct ylist_head pointer.
+ * @type:	the type of the struct this is embedded in.
+ * @member:	the name of the list_struct within the struct.
+ */
+#define ylist_entry_rcu(ptr, type, member) \
+	container_of(yatomic_load_acquire(&(ptr)), type, member)
+
+/**
+ * ylist_first_or_null_rcu - get the first element from a list
+ * @ptr:	the list head to take the element from.
+ * @type:	the type of the struct this is embedded in.
+ * @member:	the name of the list_struct within the struct.
+ *
+ * Note that if the list is empty, it returns NULL.
+ */
+#define ylist_first_or_null_rcu(ptr, type, member) ({			\
+	struct ylist_head *__ptr = (ptr);				\
+	struct ylist_head *__next = ylist_next_rcu(__ptr);		\
+	__ptr != __next ? ylist_entry(__next, type, member) : NULL;	\
+})
+
+/**
+ * ylist_for_each_rcu - iterate over an rcu-protected list
+ * @pos:	the &struct ylist_head to use as a loop cursor.
+ * @head:	the head for your list.
+ *
+ * Must be called inside a yepoch.h critical section.
+ */
+#define ylist_for_each_rcu(pos, head) \
+	for (pos = ylist_next_rcu(head); pos != (head); pos = ylist_next_rcu(pos))
+
+/**
+ * ylist_for_each_entry_rcu - iterate over rcu list of given type
+ * @pos:	the type * to use as a loop cursor.
+ * @head:	the head for your list.
+ * @member:	the name of the list_struct within the struct.
+ *
+ * Must be called inside a yepoch.h critical section. The entries seen can
+ * be deleted by writers at any time, but aren't freed before the critical
+ * section ends.
+ */
+#define ylist_for_each_entry_rcu(pos, head, member)			\
+	for (pos = ylist_entry_rcu((head)->next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = ylist_entry_rcu(pos->member.next, typeof(*pos), member))
+
+/**
+ * ylist_for_each_entry_continue_rcu - continue iteration over list of given type
+ * @pos:	the type * to use as a loop cursor.
+ * @head:	the head for your list.
+ * @member:	the name of the list_struct within the struct.
+ *
+ * Continue to iterate over list of given type, continuing after
+ * the current position.
+ */
+#define ylist_for_each_entry_continue_rcu(pos, head, member)		\
+	for (pos = ylist_entry_rcu(pos->member.next, typeof(*pos), member); \
+	     &pos->member != (head);					\
+	     pos = ylist_entry_rcu(pos->member.next, typeof(*pos), member))
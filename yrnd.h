@@ -48,3 +48,22 @@ uint64_t yrnd_xorshift1024s(struct yrnd_s1024 *s) {
 	ss[s->p] = s0^s1;
 	return ss[s->p]*1181783497276652981LL; 
 }
+
+/* This is a splitmix64 RNG written in 2015 by Sebastiano Vigna (vigna@acm.org)
+ * Only meant for seeding the other generators from a single 64bit value.
+ * Details: http://xorshift.di.unimi.it/splitmix64.c
+ */
+
+static inline uint64_t
+yrnd_splitmix64(uint64_t *state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+	z = (z^(z>>27))*0x94D049BB133111EBULL;
+	return z^(z>>31);
+}
+
+static inline void
+yrnd_s128_seed(struct yrnd_s128 *state, uint64_t seed) {
+	state->s[0] = yrnd_splitmix64(&seed);
+	state->s[1] = yrnd_splitmix64(&seed);
+}
@@ -1,74 +1,208 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "ydef.h"
+#include "compiler.h"
+#include "yrnd.h"
 
 #ifndef MAX_HEIGHT
 # define MAX_HEIGHT 32
 #endif
 
+/* A node reaches the next level with probability 1/2^YSKIPLIST_BRANCH_BITS.
+ * Larger values give shorter towers, at the cost of more hops per level. */
+#ifndef YSKIPLIST_BRANCH_BITS
+# define YSKIPLIST_BRANCH_BITS 1
+#endif
+
+/* Define GET_RANDOM to override the random source used for node heights,
+ * it should give 64 random bits. By default a per-thread xorshift128+ is
+ * used, which doesn't take any locks. */
 #ifndef GET_RANDOM
-# define GET_RANDOM (random())
+# define GET_RANDOM (yskiplist_random())
 #endif
 
+/*
+ * The tower of a node is allocated inline, right after the node itself:
+ * h forward pointers, followed by h backward pointers (only one for lists
+ * created with YSKIPLIST_COMPACT), and for lists created with
+ * YSKIPLIST_INDEXED, h span widths. So a node must be
+ * the last member of the struct it's embedded in, and the containing
+ * struct has to be allocated with room for the tower, see
+ * yskiplist_alloc_entry().
+ *
+ * Keeping all the forward pointers together means a search hop only
+ * touches the node, not a separately allocated array.
+ */
 struct yskiplist_head {
-	struct yskiplist_head **next, **prev;
 	int h;
+	/* Only used in list heads: the number of levels that are in use,
+	 * searches start from there. 0 for other nodes. */
+	unsigned short level;
+	/* YSKIPLIST_* flags of the list, nodes get them when linked */
+	unsigned short flags;
+	struct yskiplist_head *next[];
 };
 
+/*
+ * Keep the number of level 0 hops each forward pointer skips, so elements
+ * can be looked up by their position in O(log n), see yskiplist_rank()
+ * and yskiplist_select(). Spans of NULL forward pointers are meaningless.
+ */
+#define YSKIPLIST_INDEXED 1
+
+/*
+ * Only keep the backward pointer of level 0, which brings a node from 2h
+ * pointers down to h+1. Nodes are still unlinked in O(log n) expected
+ * time, by walking back on level 0 to the predecessors on upper levels,
+ * but yskiplist_delete() and yskiplist_node_rank() can't be used on lists
+ * that are also indexed, since they'd have to walk back to the head.
+ * Remove nodes from those with yskiplist_remove() instead.
+ */
+#define YSKIPLIST_COMPACT 2
+
+//Number of backward pointers in the tower of a node of height h
+#define yskiplist_nprev(flags, h) ((flags)&YSKIPLIST_COMPACT ? 1 : (h))
+
+#define yskiplist_prev(n) ((n)->next+(n)->h)
+#define yskiplist_span(n) \
+	((size_t *)(yskiplist_prev(n)+yskiplist_nprev((n)->flags, (n)->h)))
+
+#define yskiplist_tower_size(flags, h) \
+	(((size_t)(h)+yskiplist_nprev(flags, h))*				\
+	 sizeof(struct yskiplist_head *)+					\
+	 ((flags)&YSKIPLIST_INDEXED ? (size_t)(h)*sizeof(size_t) : 0))
+
+#define yskiplist_node_size(flags, h) \
+	(sizeof(struct yskiplist_head)+yskiplist_tower_size(flags, h))
+
 #define yskiplist_entry(ptr, type, member) \
 	container_of(ptr, type, member)
 
 #define yskiplist_empty(ptr) \
-	((ptr)->next == NULL || (ptr)->next[0] == NULL)
+	((ptr)->next[0] == NULL)
 
-static inline void yskiplist_init_head(struct yskiplist_head *h){
-	h->h = MAX_HEIGHT;
-	h->next = calloc(MAX_HEIGHT, sizeof(void *));
-	h->prev = NULL;
+//Allocate a list head, flags are YSKIPLIST_* flags.
+static inline struct yskiplist_head *yskiplist_new_head(int flags){
+	struct yskiplist_head *h =
+		calloc(1, yskiplist_node_size(flags, MAX_HEIGHT));
+	if (h) {
+		h->h = MAX_HEIGHT;
+		h->level = 1;
+		h->flags = flags;
+	}
+	return h;
 }
 
-static inline void yskiplist_deinit_head(struct yskiplist_head *h){
-	h->h = 0;
-	free(h->next);
-	h->next = NULL;
+static inline void yskiplist_free_head(struct yskiplist_head *h){
+	free(h);
 }
 
-static inline int yskiplist_gen_height(void){
-	int r = GET_RANDOM;
-	int h = 1;
-	for(;r&1;r>>=1)
-		h++;
-	return h;
+static _Thread_local struct yrnd_s128 _yskiplist_rnd;
+static uint64_t _yskiplist_nseeded;
+
+//Seed the random source of the calling thread.
+static inline void yskiplist_seed(uint64_t seed){
+	yrnd_s128_seed(&_yskiplist_rnd, seed);
 }
 
-static inline void yskiplist_init_node(struct yskiplist_head *n){
-	int newh = yskiplist_gen_height();
-	n->next = talloc(newh, struct yskiplist_head *);
-	n->prev = talloc(newh, struct yskiplist_head *);
-	n->h = newh;
+/*
+ * The counter is per translation unit, so it's mixed with the address of
+ * the thread's state and the time, to keep threads that start using lists
+ * from different files from getting the same seed.
+ */
+static inline uint64_t _yskiplist_auto_seed(void){
+	struct timespec ts;
+	uint64_t seed = __atomic_add_fetch(&_yskiplist_nseeded, 1,
+					   __ATOMIC_RELAXED);
+	seed ^= (uint64_t)(uintptr_t)&_yskiplist_rnd*0x9e3779b97f4a7c15ULL;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		seed ^= ((uint64_t)ts.tv_sec<<32)^(uint64_t)ts.tv_nsec;
+	return seed;
 }
 
-static inline void yskiplist_deinit_node(struct yskiplist_head *n){
-	free(n->next);
-	free(n->prev);
-	n->next = n->prev = NULL;
-	n->h = 0;
+static inline uint64_t yskiplist_random(void){
+	if (unlikely(!_yskiplist_rnd.s[0] && !_yskiplist_rnd.s[1]))
+		//Each thread gets a different seed
+		yskiplist_seed(_yskiplist_auto_seed());
+	return yrnd_xorshift128p(&_yskiplist_rnd);
 }
 
+static inline int yskiplist_gen_height(void){
+	uint64_t r = GET_RANDOM;
+	int h;
+	if (!r)
+		return MAX_HEIGHT;
+	h = 1+__builtin_ctzll(r)/YSKIPLIST_BRANCH_BITS;
+	return h > MAX_HEIGHT ? MAX_HEIGHT : h;
+}
+
+/*
+ * yskiplist_init_node: Prepare a node for insertion
+ * @n: the node, which must have room for a tower of height @h, with the
+ *     flags of the list it will be inserted into
+ * @h: height of the node, usually from yskiplist_gen_height()
+ *
+ * A node keeps its height after being deleted, so it can be inserted
+ * again without calling this.
+ */
+static inline void yskiplist_init_node(struct yskiplist_head *n, int h){
+	assert(h > 0 && h <= MAX_HEIGHT);
+	n->h = h;
+	n->level = 0;
+	n->flags = 0;
+}
+
+/*
+ * yskiplist_alloc_entry_height - allocate a struct that embeds a skiplist node
+ * @head:	the list the node is for.
+ * @type:	the type of the struct.
+ * @member:	the name of the yskiplist_head within the struct, it must
+ *		be the last member.
+ * @height:	height of the node.
+ *
+ * The whole entry, tower included, is a single allocation, and the node
+ * is initialized. Free it with free().
+ */
+#define yskiplist_alloc_entry_height(head, type, member, height) ({	\
+	int __h = (height);						\
+	type *__e = calloc(1, sizeof(type)+				\
+			   yskiplist_tower_size((head)->flags, __h));	\
+	if (__e)							\
+		yskiplist_init_node(&__e->member, __h);			\
+	__e;})
+
+//Like yskiplist_alloc_entry_height, with a random height.
+#define yskiplist_alloc_entry(head, type, member) \
+	yskiplist_alloc_entry_height(head, type, member, yskiplist_gen_height())
+
 typedef int (*yskiplist_cmp)(struct yskiplist_head *a, void *key);
 
 static int yskiplist_last_cmp(struct yskiplist_head *a, void *key){
 	return a ? -1 : 1;
 }
 
+//Drop the empty levels at the top of a list head
+static inline void _yskiplist_shrink(struct yskiplist_head *head){
+	while(head->level > 1 && !head->next[head->level-1])
+		head->level--;
+}
+
+/*
+ * yskiplist_previous: Find the last node less than key on every level
+ * @res: filled with the predecessors, for levels below head->level
+ */
 static inline void yskiplist_previous(struct yskiplist_head *head,
 				      void *key, yskiplist_cmp cmp,
 				      struct yskiplist_head **res){
-	int h = head->h-1;
+	int h = head->level-1;
 	struct yskiplist_head *n = head;
 	while(1){
 		while(h >= 0 &&
@@ -83,38 +217,124 @@ static inline void yskiplist_previous(struct yskiplist_head *head,
 	}
 }
 
+/*
+ * Like yskiplist_previous, also stores the position of res[i] in rank[i],
+ * the head being at 0. Only for indexed lists.
+ */
 static inline void
-yskiplist_insert(struct yskiplist_head *h, struct yskiplist_head *n,
-		      void *key, yskiplist_cmp cmp) {
-	yskiplist_init_node(n);
+_yskiplist_previous_rank(struct yskiplist_head *head, void *key,
+			 yskiplist_cmp cmp, struct yskiplist_head **res,
+			 size_t *rank){
 	int i;
-	struct yskiplist_head *hs[MAX_HEIGHT];
-	yskiplist_previous(h, key, cmp, hs);
+	size_t r = 0;
+	struct yskiplist_head *n = head;
+	for(i = head->level-1; i >= 0; i--){
+		while(n->next[i] && cmp(n->next[i], key) < 0){
+			r += yskiplist_span(n)[i];
+			n = n->next[i];
+		}
+		res[i] = n;
+		rank[i] = r;
+	}
+}
+
+/*
+ * Link n after hs[i] on each of its levels. hs and rank (indexed lists
+ * only, NULL otherwise) only need to be valid for levels below
+ * head->level.
+ */
+static inline void
+_yskiplist_link(struct yskiplist_head *head, struct yskiplist_head **hs,
+		size_t *rank, struct yskiplist_head *n){
+	int i;
+	struct yskiplist_head **prev = yskiplist_prev(n);
+	int nprev;
+	for(i = head->level; i < n->h; i++) {
+		hs[i] = head;
+		if (rank)
+			rank[i] = 0;
+	}
+	n->flags = head->flags;
+	nprev = yskiplist_nprev(n->flags, n->h);
+	if (head->flags&YSKIPLIST_INDEXED) {
+		size_t *span = yskiplist_span(n);
+		for(i = 0; i < n->h; i++) {
+			span[i] = hs[i]->next[i] ?
+				rank[i]+yskiplist_span(hs[i])[i]-rank[0] : 0;
+			yskiplist_span(hs[i])[i] = rank[0]+1-rank[i];
+		}
+		for(; i < head->level; i++)
+			if (hs[i]->next[i])
+				yskiplist_span(hs[i])[i]++;
+	}
+	if (n->h > head->level)
+		head->level = n->h;
 	for(i = 0; i < n->h; i++) {
 		n->next[i] = hs[i]->next[i];
 		hs[i]->next[i] = n;
-		n->prev[i] = hs[i];
+	}
+	for(i = 0; i < nprev; i++) {
+		prev[i] = hs[i];
+		if (n->next[i])
+			yskiplist_prev(n->next[i])[i] = n;
+	}
+}
+
+//Unlink n, hs[i] must be the node before n on level i.
+static inline void
+_yskiplist_unlink(struct yskiplist_head *head, struct yskiplist_head **hs,
+		  struct yskiplist_head *n){
+	int i;
+	if (head->flags&YSKIPLIST_INDEXED) {
+		for(i = 0; i < n->h; i++)
+			yskiplist_span(hs[i])[i] = n->next[i] ?
+				yskiplist_span(hs[i])[i]+yskiplist_span(n)[i]-1 : 0;
+		for(; i < head->level; i++)
+			if (hs[i]->next[i])
+				yskiplist_span(hs[i])[i]--;
 	}
 	for(i = 0; i < n->h; i++) {
-		if (!n->next[i])
-			break;
-		n->next[i]->prev[i] = n;
+		assert(hs[i]->next[i] == n);
+		hs[i]->next[i] = n->next[i];
+	}
+	for(i = 0; i < yskiplist_nprev(n->flags, n->h); i++)
+		if (n->next[i])
+			yskiplist_prev(n->next[i])[i] = hs[i];
+	_yskiplist_shrink(head);
+}
+
+/*
+ * yskiplist_insert: Insert a node into the list
+ * @h: the list head
+ * @n: the node, initialized by yskiplist_init_node()
+ *
+ * This doesn't allocate memory.
+ */
+static inline void
+yskiplist_insert(struct yskiplist_head *h, struct yskiplist_head *n,
+		      void *key, yskiplist_cmp cmp) {
+	struct yskiplist_head *hs[MAX_HEIGHT];
+	size_t rank[MAX_HEIGHT];
+	if (h->flags&YSKIPLIST_INDEXED) {
+		_yskiplist_previous_rank(h, key, cmp, hs, rank);
+		_yskiplist_link(h, hs, rank, n);
+	} else {
+		yskiplist_previous(h, key, cmp, hs);
+		_yskiplist_link(h, hs, NULL, n);
 	}
 }
 
 //Find the smallest element that is greater than or equal to key.
 static inline struct yskiplist_head *
 yskiplist_find_ge(struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
-	int i;
 	struct yskiplist_head *hs[MAX_HEIGHT];
 	yskiplist_previous(h, key, cmp, hs);
 	return hs[0]->next[0];
 }
 
-//Find the smallest element that is less than or equal to key.
+//Find the largest element that is less than or equal to key.
 static inline struct yskiplist_head *
 yskiplist_find_le(struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
-	int i;
 	struct yskiplist_head *hs[MAX_HEIGHT];
 	yskiplist_previous(h, key, cmp, hs);
 	if (hs[0]->next[0] && cmp(hs[0]->next[0], key) == 0)
@@ -122,35 +342,223 @@ yskiplist_find_le(struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
 	return hs[0] == h ? NULL : hs[0];
 }
 
+/* Number of searches yskiplist_find_ge_batch() keeps in flight */
+#ifndef YSKIPLIST_BATCH
+# define YSKIPLIST_BATCH 16
+#endif
+
+/*
+ * yskiplist_find_ge_batch: yskiplist_find_ge() for many keys at once
+ * @keys: the keys to look up
+ * @n: number of keys
+ * @res: filled with the result for each key
+ *
+ * Up to YSKIPLIST_BATCH searches are advanced in turns, one hop each, and
+ * the node a search will look at next is prefetched before moving on to
+ * the other searches. So the cache misses of different searches overlap,
+ * instead of each search waiting for its own, one after another.
+ */
+static inline void
+yskiplist_find_ge_batch(struct yskiplist_head *h, void **keys, size_t n,
+			yskiplist_cmp cmp, struct yskiplist_head **res){
+	struct {
+		struct yskiplist_head *x, *nx;
+		size_t k;
+		int lvl;
+	} s[YSKIPLIST_BATCH];
+	size_t next = 0;
+	int i, nslot = 0, active;
+
+	for(; nslot < YSKIPLIST_BATCH && next < n; nslot++){
+		s[nslot].x = h;
+		s[nslot].k = next++;
+		s[nslot].lvl = h->level-1;
+		s[nslot].nx = h->next[h->level-1];
+		__builtin_prefetch(s[nslot].nx);
+	}
+	active = nslot;
+	while(active){
+		for(i = 0; i < nslot; i++){
+			struct yskiplist_head *nx = s[i].nx;
+			if (!s[i].x)
+				continue;
+			if (nx && cmp(nx, keys[s[i].k]) < 0) {
+				s[i].x = nx;
+			} else if (s[i].lvl-- == 0) {
+				res[s[i].k] = nx;
+				if (next == n) {
+					s[i].x = NULL;
+					active--;
+					continue;
+				}
+				//Start the next search in this slot
+				s[i].x = h;
+				s[i].k = next++;
+				s[i].lvl = h->level-1;
+			}
+			s[i].nx = s[i].x->next[s[i].lvl];
+			__builtin_prefetch(s[i].nx);
+		}
+	}
+}
+
 static inline struct yskiplist_head *
 yskiplist_extract_by_key(struct yskiplist_head *h, void *key,
 			 yskiplist_cmp cmp){
-	int i;
 	struct yskiplist_head *hs[MAX_HEIGHT];
 	yskiplist_previous(h, key, cmp, hs);
 	struct yskiplist_head *node = hs[0]->next[0];
 	if (!node || cmp(node, key) != 0)
 		return NULL;
-	for(i = 0; i < node->h; i++) {
-		assert(hs[i] == node->prev[i]);
-		hs[i]->next[i] = node->next[i];
-		if (node->next[i])
-			node->next[i]->prev[i] = node->prev[i];
-	}
-	yskiplist_deinit_node(node);
+	_yskiplist_unlink(h, hs, node);
 	return node;
 }
 
 
+/*
+ * yskiplist_delete: Remove a node from the list it's in
+ *
+ * Can't be used on lists that are both YSKIPLIST_COMPACT and
+ * YSKIPLIST_INDEXED.
+ */
 static inline void
 yskiplist_delete(struct yskiplist_head *h){
 	int i;
+	struct yskiplist_head **prev = yskiplist_prev(h);
+	if (h->flags&YSKIPLIST_COMPACT) {
+		struct yskiplist_head *p = prev[0];
+		assert(!(h->flags&YSKIPLIST_INDEXED));
+		//Walk back to the nodes before h on the upper levels
+		for(i = 0; i < h->h; i++) {
+			while(!p->level && p->h <= i)
+				p = yskiplist_prev(p)[0];
+			p->next[i] = h->next[i];
+		}
+		if (h->next[0])
+			yskiplist_prev(h->next[0])[0] = prev[0];
+		if (p->level)
+			_yskiplist_shrink(p);
+		return;
+	}
+	if (h->flags&YSKIPLIST_INDEXED) {
+		struct yskiplist_head *p = h;
+		for(i = 0; i < h->h; i++)
+			yskiplist_span(prev[i])[i] = h->next[i] ?
+				yskiplist_span(prev[i])[i]+yskiplist_span(h)[i]-1 : 0;
+		//Walk back to the nodes skipping over h on the upper levels
+		for(; ; i++) {
+			while(!p->level && p->h <= i)
+				p = yskiplist_prev(p)[p->h-1];
+			if (p->level && i >= p->level)
+				break;
+			if (p->next[i])
+				yskiplist_span(p)[i]--;
+		}
+	}
 	for(i = 0; i < h->h; i++) {
-		h->prev[i]->next[i] = h->next[i];
+		prev[i]->next[i] = h->next[i];
 		if (h->next[i])
-			h->next[i]->prev[i] = h->prev[i];
+			yskiplist_prev(h->next[i])[i] = prev[i];
+	}
+	//Only the top level can be emptied, by the list head
+	if (prev[h->h-1]->level)
+		_yskiplist_shrink(prev[h->h-1]);
+}
+
+/*
+ * yskiplist_remove: Remove node n, found by searching for its key
+ *
+ * Doesn't use the backward pointers, so it works on every kind of list.
+ * Elements equal to key that are before n are stepped over.
+ */
+static inline void
+yskiplist_remove(struct yskiplist_head *h, struct yskiplist_head *n,
+		 void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *hs[MAX_HEIGHT], *x;
+	int i;
+	yskiplist_previous(h, key, cmp, hs);
+	for(x = hs[0]->next[0]; x != n; x = x->next[0]) {
+		assert(x);
+		for(i = 0; i < x->h; i++)
+			hs[i] = x;
+	}
+	_yskiplist_unlink(h, hs, n);
+}
+
+/*
+ * yskiplist_bulk_height: Height of the i-th node of a bulk loaded list
+ *
+ * Every 2^YSKIPLIST_BRANCH_BITS-th node is promoted to the next level, so
+ * nodes allocated with these heights and passed to yskiplist_bulk_load()
+ * form a perfectly balanced list.
+ */
+static inline int yskiplist_bulk_height(size_t i){
+	int h = 1+__builtin_ctzll(i+1)/YSKIPLIST_BRANCH_BITS;
+	return h > MAX_HEIGHT ? MAX_HEIGHT : h;
+}
+
+/*
+ * yskiplist_bulk_append: Append sorted nodes after the end of the list
+ * @h: the list head
+ * @nodes: initialized nodes, sorted, none of them less than the last
+ *	   element in the list
+ * @n: number of nodes
+ *
+ * Takes O(log(size of the list) + n) time, without comparing any keys
+ * beyond finding the current end of the list.
+ */
+static inline void
+yskiplist_bulk_append(struct yskiplist_head *h, struct yskiplist_head **nodes,
+		      size_t n){
+	struct yskiplist_head *tails[MAX_HEIGHT];
+	size_t rank[MAX_HEIGHT];
+	bool indexed = h->flags&YSKIPLIST_INDEXED;
+	size_t j;
+	int i;
+	if (indexed)
+		_yskiplist_previous_rank(h, NULL, yskiplist_last_cmp, tails, rank);
+	else
+		yskiplist_previous(h, NULL, yskiplist_last_cmp, tails);
+	for(i = h->level; i < MAX_HEIGHT; i++) {
+		tails[i] = h;
+		rank[i] = 0;
+	}
+	for(j = 0; j < n; j++){
+		struct yskiplist_head *x = nodes[j];
+		struct yskiplist_head **prev = yskiplist_prev(x);
+		size_t pos = rank[0]+1;
+		x->flags = h->flags;
+		for(i = 0; i < x->h; i++){
+			tails[i]->next[i] = x;
+			if (i < yskiplist_nprev(x->flags, x->h))
+				prev[i] = tails[i];
+			if (indexed) {
+				yskiplist_span(tails[i])[i] = pos-rank[i];
+				rank[i] = pos;
+			}
+			tails[i] = x;
+		}
+		if (x->h > h->level)
+			h->level = x->h;
 	}
-	yskiplist_deinit_node(h);
+	for(i = 0; i < h->level; i++)
+		tails[i]->next[i] = NULL;
+}
+
+/*
+ * yskiplist_bulk_load: Build a list from sorted nodes
+ * @h: an empty list head
+ * @nodes: initialized nodes, sorted, see yskiplist_bulk_height()
+ * @n: number of nodes
+ *
+ * Takes O(n) time, compared to O(n log n) for inserting the nodes one
+ * by one.
+ */
+static inline void
+yskiplist_bulk_load(struct yskiplist_head *h, struct yskiplist_head **nodes,
+		    size_t n){
+	assert(yskiplist_empty(h));
+	yskiplist_bulk_append(h, nodes, n);
 }
 
 static inline void
@@ -162,5 +570,699 @@ yskiplist_clear(struct yskiplist_head *h,
 		freep(hx);
 		hx = tmp;
 	}
+	memset(h->next, 0, h->level*sizeof(h->next[0]));
+	h->level = 1;
+}
+
+/*
+ * Get the predecessors of key on all MAX_HEIGHT levels, and their positions
+ * too if the list is indexed.
+ */
+static inline void
+_yskiplist_previous_all(struct yskiplist_head *h, void *key, yskiplist_cmp cmp,
+			struct yskiplist_head **hs, size_t *rank){
+	int i;
+	if (h->flags&YSKIPLIST_INDEXED)
+		_yskiplist_previous_rank(h, key, cmp, hs, rank);
+	else
+		yskiplist_previous(h, key, cmp, hs);
+	for(i = h->level; i < MAX_HEIGHT; i++) {
+		hs[i] = h;
+		rank[i] = 0;
+	}
+}
+
+/*
+ * Unlink the nodes between pl[0] and ph[0] (ph[0] included) on every
+ * level, and move them into dst if it's not NULL.
+ * @return: the first node unlinked, or NULL if there's none
+ */
+static inline struct yskiplist_head *
+_yskiplist_cut(struct yskiplist_head *h, struct yskiplist_head **pl,
+	       size_t *rl, struct yskiplist_head **ph, size_t *rh,
+	       struct yskiplist_head *dst){
+	struct yskiplist_head *first = pl[0]->next[0];
+	bool indexed = h->flags&YSKIPLIST_INDEXED;
+	size_t cnt = rh[0]-rl[0];
+	int i;
+	if (pl[0] == ph[0])
+		return NULL;
+	//Levels that have nodes in the range form a prefix
+	for(i = 0; i < h->level && pl[i] != ph[i]; i++) {
+		struct yskiplist_head *f = pl[i]->next[i], *after = ph[i]->next[i];
+		if (indexed) {
+			if (dst)
+				yskiplist_span(dst)[i] =
+					rl[i]+yskiplist_span(pl[i])[i]-rl[0];
+			yskiplist_span(pl[i])[i] = after ?
+				rh[i]+yskiplist_span(ph[i])[i]-rl[i]-cnt : 0;
+			yskiplist_span(ph[i])[i] = 0;
+		}
+		pl[i]->next[i] = after;
+		ph[i]->next[i] = NULL;
+		if (dst)
+			dst->next[i] = f;
+		if (i >= yskiplist_nprev(h->flags, MAX_HEIGHT))
+			continue;
+		if (after)
+			yskiplist_prev(after)[i] = pl[i];
+		if (dst)
+			yskiplist_prev(f)[i] = dst;
+	}
+	if (dst)
+		dst->level = i;
+	if (indexed)
+		for(; i < h->level; i++)
+			if (pl[i]->next[i])
+				yskiplist_span(pl[i])[i] -= cnt;
+	_yskiplist_shrink(h);
+	return first;
 }
 
+/*
+ * Whether [lo, hi) is empty, given the last element less than hi. This
+ * also catches hi < lo, which _yskiplist_cut() can't handle.
+ */
+static inline bool
+_yskiplist_range_empty(struct yskiplist_head *h, struct yskiplist_head *last,
+		       void *lo, yskiplist_cmp cmp){
+	return last == h || cmp(last, lo) < 0;
+}
+
+/*
+ * yskiplist_cut_range: Move all elements in [lo, hi) to another list
+ * @h: the list to cut from
+ * @dst: an empty list head, with the same flags as @h
+ *
+ * This only takes two descents, the elements in between are not visited.
+ * Nothing is moved if the range is empty, including when hi < lo.
+ */
+static inline void
+yskiplist_cut_range(struct yskiplist_head *h, void *lo, void *hi,
+		    yskiplist_cmp cmp, struct yskiplist_head *dst){
+	struct yskiplist_head *pl[MAX_HEIGHT], *ph[MAX_HEIGHT];
+	size_t rl[MAX_HEIGHT], rh[MAX_HEIGHT];
+	assert(yskiplist_empty(dst) && dst->flags == h->flags);
+	_yskiplist_previous_all(h, hi, cmp, ph, rh);
+	if (_yskiplist_range_empty(h, ph[0], lo, cmp))
+		return;
+	_yskiplist_previous_all(h, lo, cmp, pl, rl);
+	_yskiplist_cut(h, pl, rl, ph, rh, dst);
+}
+
+/*
+ * yskiplist_delete_range: Remove all elements in [lo, hi)
+ * @freep: called on every removed element, can be NULL
+ * @return: the number of elements removed
+ *
+ * Nothing is removed if the range is empty, including when hi < lo.
+ */
+static inline size_t
+yskiplist_delete_range(struct yskiplist_head *h, void *lo, void *hi,
+		       yskiplist_cmp cmp,
+		       void (*freep)(struct yskiplist_head *)){
+	struct yskiplist_head *pl[MAX_HEIGHT], *ph[MAX_HEIGHT];
+	size_t rl[MAX_HEIGHT], rh[MAX_HEIGHT], cnt = 0;
+	struct yskiplist_head *n;
+	_yskiplist_previous_all(h, hi, cmp, ph, rh);
+	if (_yskiplist_range_empty(h, ph[0], lo, cmp))
+		return 0;
+	_yskiplist_previous_all(h, lo, cmp, pl, rl);
+	n = _yskiplist_cut(h, pl, rl, ph, rh, NULL);
+	while(n){
+		struct yskiplist_head *tmp = n->next[0];
+		if (freep)
+			freep(n);
+		n = tmp;
+		cnt++;
+	}
+	return cnt;
+}
+
+/*
+ * Move all elements of src in between p[i] and p[i]->next[i] on every
+ * level, p and rank are from _yskiplist_previous_all().
+ */
+static inline void
+_yskiplist_splice(struct yskiplist_head *h, struct yskiplist_head **p,
+		  size_t *rank, struct yskiplist_head *src){
+	struct yskiplist_head *st[MAX_HEIGHT];
+	size_t srank[MAX_HEIGHT];
+	bool indexed = h->flags&YSKIPLIST_INDEXED;
+	size_t cnt;
+	int i;
+	_yskiplist_previous_all(src, NULL, yskiplist_last_cmp, st, srank);
+	cnt = srank[0];
+	for(i = 0; i < src->level; i++) {
+		struct yskiplist_head *f = src->next[i], *after = p[i]->next[i];
+		if (indexed) {
+			size_t old = yskiplist_span(p[i])[i];
+			yskiplist_span(p[i])[i] =
+				rank[0]-rank[i]+yskiplist_span(src)[i];
+			yskiplist_span(st[i])[i] = after ?
+				rank[i]+old+cnt-rank[0]-srank[i] : 0;
+		}
+		p[i]->next[i] = f;
+		st[i]->next[i] = after;
+		if (i >= yskiplist_nprev(h->flags, MAX_HEIGHT))
+			continue;
+		yskiplist_prev(f)[i] = p[i];
+		if (after)
+			yskiplist_prev(after)[i] = st[i];
+	}
+	if (indexed)
+		for(; i < h->level; i++)
+			if (p[i]->next[i])
+				yskiplist_span(p[i])[i] += cnt;
+	if (src->level > h->level)
+		h->level = src->level;
+	memset(src->next, 0, src->level*sizeof(src->next[0]));
+	src->level = 1;
+}
+
+/*
+ * yskiplist_splice: Move all elements of src into h
+ * @src: a list with the same flags as @h, its elements must all fit in
+ *	 between two adjacent elements of @h. It's empty afterwards.
+ * @key: key of the first element of @src
+ *
+ * Only the boundaries on each level are relinked, so this takes
+ * O(log n + log m) time.
+ */
+static inline void
+yskiplist_splice(struct yskiplist_head *h, struct yskiplist_head *src,
+		 void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *p[MAX_HEIGHT];
+	size_t rank[MAX_HEIGHT];
+	assert(src->flags == h->flags);
+	if (yskiplist_empty(src))
+		return;
+	_yskiplist_previous_all(h, key, cmp, p, rank);
+	_yskiplist_splice(h, p, rank, src);
+}
+
+/*
+ * yskiplist_split: Move all elements greater than or equal to key into dst
+ * @dst: an empty list head, with the same flags as @h
+ *
+ * Takes O(log n) time, like yskiplist_cut_range().
+ */
+static inline void
+yskiplist_split(struct yskiplist_head *h, void *key, yskiplist_cmp cmp,
+		struct yskiplist_head *dst){
+	struct yskiplist_head *pl[MAX_HEIGHT], *ph[MAX_HEIGHT];
+	size_t rl[MAX_HEIGHT], rh[MAX_HEIGHT];
+	assert(yskiplist_empty(dst) && dst->flags == h->flags);
+	_yskiplist_previous_all(h, key, cmp, pl, rl);
+	_yskiplist_previous_all(h, NULL, yskiplist_last_cmp, ph, rh);
+	_yskiplist_cut(h, pl, rl, ph, rh, dst);
+}
+
+/*
+ * yskiplist_concat: Append all elements of src to h
+ * @src: a list with the same flags as @h, none of its elements is less
+ *	 than the last element of @h. It's empty afterwards.
+ *
+ * Takes O(log n + log m) time, without comparing any keys.
+ */
+static inline void
+yskiplist_concat(struct yskiplist_head *h, struct yskiplist_head *src){
+	struct yskiplist_head *p[MAX_HEIGHT];
+	size_t rank[MAX_HEIGHT];
+	assert(src->flags == h->flags);
+	if (yskiplist_empty(src))
+		return;
+	_yskiplist_previous_all(h, NULL, yskiplist_last_cmp, p, rank);
+	_yskiplist_splice(h, p, rank, src);
+}
+
+/*
+ * Priority queue operations, the list head is kept in order so the
+ * minimum is always head->next[0].
+ */
+
+//Get the smallest element without removing it.
+static inline struct yskiplist_head *yskiplist_peek_min(struct yskiplist_head *h){
+	return h->next[0];
+}
+
+/*
+ * yskiplist_pop_min: Remove the smallest element
+ * @return: the element, or NULL if the list is empty
+ *
+ * The predecessors of the first element are all the head, so no search is
+ * needed. Takes O(height of the element) time, which is O(1) expected,
+ * plus O(log n) to fix up the spans of indexed lists.
+ */
+static inline struct yskiplist_head *yskiplist_pop_min(struct yskiplist_head *h){
+	struct yskiplist_head *hs[MAX_HEIGHT], *n = h->next[0];
+	int i, top;
+	if (!n)
+		return NULL;
+	top = h->flags&YSKIPLIST_INDEXED ? h->level : n->h;
+	for(i = 0; i < top; i++)
+		hs[i] = h;
+	_yskiplist_unlink(h, hs, n);
+	return n;
+}
+
+/*
+ * yskiplist_pop_below: Remove all elements less than key
+ * @return: the removed elements, linked through next[0] and terminated
+ * by NULL, or NULL if there are none
+ *
+ * Only takes one descent, no matter how many elements are removed.
+ */
+static inline struct yskiplist_head *
+yskiplist_pop_below(struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *pl[MAX_HEIGHT], *ph[MAX_HEIGHT];
+	size_t rl[MAX_HEIGHT], rh[MAX_HEIGHT];
+	int i;
+	for(i = 0; i < MAX_HEIGHT; i++) {
+		pl[i] = h;
+		rl[i] = 0;
+	}
+	_yskiplist_previous_all(h, key, cmp, ph, rh);
+	return _yskiplist_cut(h, pl, rl, ph, rh, NULL);
+}
+
+/*
+ * yskiplist_update_key: Move a node after its key has changed
+ * @n: a node in @h, whose key has already been changed to @key
+ *
+ * Nothing is relinked if n is still in order with its neighbours, which
+ * is common for small changes. Otherwise n is unlinked with
+ * yskiplist_delete() and inserted again, so this can't be used on lists
+ * that are both YSKIPLIST_COMPACT and YSKIPLIST_INDEXED.
+ */
+static inline void
+yskiplist_update_key(struct yskiplist_head *h, struct yskiplist_head *n,
+		     void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *p = yskiplist_prev(n)[0];
+	if ((p->level || cmp(p, key) <= 0) &&
+	    (!n->next[0] || cmp(n->next[0], key) >= 0))
+		return;
+	yskiplist_delete(n);
+	yskiplist_insert(h, n, key, cmp);
+}
+
+/*
+ * A finger remembers the predecessors of the last key it was moved to, so
+ * the next search can start from there instead of from the list head.
+ * Moving the finger a distance of d nodes takes O(log d) expected time.
+ *
+ * A finger is invalidated by any modification of the list that isn't done
+ * through it.
+ */
+struct yskiplist_finger {
+	struct yskiplist_head *head;
+	struct yskiplist_head *pred[MAX_HEIGHT];
+	//Positions of pred, for indexed lists
+	size_t rank[MAX_HEIGHT];
+};
+
+static inline void
+yskiplist_finger_init(struct yskiplist_finger *f, struct yskiplist_head *head){
+	int i;
+	f->head = head;
+	for(i = 0; i < MAX_HEIGHT; i++) {
+		f->pred[i] = head;
+		f->rank[i] = 0;
+	}
+}
+
+/*
+ * yskiplist_finger_seek: Move the finger to key
+ * @return: the smallest element that is greater than or equal to key
+ */
+static inline struct yskiplist_head *
+yskiplist_finger_seek(struct yskiplist_finger *f, void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *head = f->head, **pred = f->pred, *x;
+	bool indexed = head->flags&YSKIPLIST_INDEXED;
+	int i, lvl = 0;
+	size_t r;
+	if (pred[0] != head && cmp(pred[0], key) >= 0) {
+		//Backward, climb until the predecessor is before key
+		while(lvl+1 < head->level && pred[lvl+1] != head &&
+		      cmp(pred[lvl+1], key) >= 0)
+			lvl++;
+		if (head->flags&YSKIPLIST_COMPACT) {
+			//Can't walk back, start from the predecessor above
+			if (lvl+1 < head->level) {
+				lvl++;
+				x = pred[lvl];
+				r = f->rank[lvl];
+			} else {
+				x = head;
+				r = 0;
+			}
+		} else {
+			x = pred[lvl];
+			r = f->rank[lvl];
+		}
+		while(x != head && cmp(x, key) >= 0) {
+			x = yskiplist_prev(x)[lvl];
+			if (indexed)
+				r -= yskiplist_span(x)[lvl];
+		}
+	} else {
+		//Forward, climb until the next node is after key
+		while(lvl+1 < head->level && pred[lvl+1]->next[lvl+1] &&
+		      cmp(pred[lvl+1]->next[lvl+1], key) < 0)
+			lvl++;
+		x = pred[lvl];
+		r = f->rank[lvl];
+	}
+	for(i = lvl; i >= 0; i--){
+		while(x->next[i] && cmp(x->next[i], key) < 0) {
+			if (indexed)
+				r += yskiplist_span(x)[i];
+			x = x->next[i];
+		}
+		pred[i] = x;
+		f->rank[i] = r;
+	}
+	return x->next[0];
+}
+
+//Find the smallest element that is greater than or equal to key.
+static inline struct yskiplist_head *
+yskiplist_finger_find_ge(struct yskiplist_finger *f, void *key,
+			 yskiplist_cmp cmp){
+	return yskiplist_finger_seek(f, key, cmp);
+}
+
+//Find the largest element that is less than or equal to key.
+static inline struct yskiplist_head *
+yskiplist_finger_find_le(struct yskiplist_finger *f, void *key,
+			 yskiplist_cmp cmp){
+	struct yskiplist_head *n = yskiplist_finger_seek(f, key, cmp);
+	if (n && cmp(n, key) == 0)
+		return n;
+	return f->pred[0] == f->head ? NULL : f->pred[0];
+}
+
+//Insert a node, the finger stays valid and is moved to key.
+static inline void
+yskiplist_finger_insert(struct yskiplist_finger *f, struct yskiplist_head *n,
+			void *key, yskiplist_cmp cmp){
+	yskiplist_finger_seek(f, key, cmp);
+	_yskiplist_link(f->head, f->pred, f->rank, n);
+}
+
+//Remove the node equal to key, the finger stays valid and is moved to key.
+static inline struct yskiplist_head *
+yskiplist_finger_extract(struct yskiplist_finger *f, void *key,
+			 yskiplist_cmp cmp){
+	struct yskiplist_head *n = yskiplist_finger_seek(f, key, cmp);
+	if (!n || cmp(n, key) != 0)
+		return NULL;
+	_yskiplist_unlink(f->head, f->pred, n);
+	return n;
+}
+
+/*
+ * yskiplist_rank: Count the elements less than key, in an indexed list
+ *
+ * This is also the position of the smallest element greater than or
+ * equal to key, counting from 0.
+ */
+static inline size_t
+yskiplist_rank(struct yskiplist_head *h, void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *hs[MAX_HEIGHT];
+	size_t rank[MAX_HEIGHT];
+	assert(h->flags&YSKIPLIST_INDEXED);
+	_yskiplist_previous_rank(h, key, cmp, hs, rank);
+	return rank[0];
+}
+
+//Position of a node in an indexed, non compact list, counting from 0.
+static inline size_t yskiplist_node_rank(struct yskiplist_head *n){
+	size_t r = 0;
+	assert(n->flags&YSKIPLIST_INDEXED);
+	assert(!(n->flags&YSKIPLIST_COMPACT));
+	while(!n->level){
+		struct yskiplist_head *p = yskiplist_prev(n)[n->h-1];
+		r += yskiplist_span(p)[n->h-1];
+		n = p;
+	}
+	return r-1;
+}
+
+//Find the element at position k of an indexed list, counting from 0.
+static inline struct yskiplist_head *
+yskiplist_select(struct yskiplist_head *h, size_t k){
+	struct yskiplist_head *n = h;
+	size_t pos = 0;
+	int i;
+	assert(h->flags&YSKIPLIST_INDEXED);
+	for(i = h->level-1; i >= 0; i--)
+		while(n->next[i] && pos+yskiplist_span(n)[i] <= k+1){
+			pos += yskiplist_span(n)[i];
+			n = n->next[i];
+		}
+	return pos == k+1 ? n : NULL;
+}
+
+//Count the elements in [lo, hi) of an indexed list.
+static inline size_t
+yskiplist_count_range(struct yskiplist_head *h, void *lo, void *hi,
+		      yskiplist_cmp cmp){
+	size_t a = yskiplist_rank(h, lo, cmp), b = yskiplist_rank(h, hi, cmp);
+	return b > a ? b-a : 0;
+}
+
+//Number of elements in an indexed list.
+static inline size_t yskiplist_length(struct yskiplist_head *h){
+	return yskiplist_rank(h, NULL, yskiplist_last_cmp);
+}
+
+/*
+ * A merge iterator walks several lists at once, in the order of their
+ * union. The current nodes of the lists are kept in a loser tree, so
+ * each step takes O(log k) comparisons for k lists.
+ *
+ * Elements are compared to each other with the lists' yskiplist_cmp and a
+ * function that gets the key of an element. Equal elements come out in
+ * the order of the lists they are in. The lists must not be modified
+ * while being merged.
+ */
+struct yskiplist_merge {
+	int n;
+	/* Only return the first of a run of equal elements */
+	bool dedup;
+	yskiplist_cmp cmp;
+	void *(*key)(struct yskiplist_head *);
+	struct yskiplist_head *last;
+	struct yskiplist_head **heads, **cur;
+	/* tree[0] is the winner, tree[1..n) the losers of each match */
+	int *tree;
+};
+
+//Whether list a's current node goes before list b's, ended lists go last.
+static inline bool
+_yskiplist_merge_less(struct yskiplist_merge *m, int a, int b){
+	struct yskiplist_head *na = m->cur[a], *nb = m->cur[b];
+	int c;
+	if (!na || !nb)
+		return nb ? false : na || a < b;
+	c = m->cmp(na, m->key(nb));
+	return c < 0 || (c == 0 && a < b);
+}
+
+//Replay the matches on the path of list i, after its current node changed.
+static inline void _yskiplist_merge_replay(struct yskiplist_merge *m, int i){
+	int t, w = i;
+	for(t = (i+m->n)/2; t > 0; t /= 2)
+		if (_yskiplist_merge_less(m, m->tree[t], w)) {
+			int tmp = m->tree[t];
+			m->tree[t] = w;
+			w = tmp;
+		}
+	m->tree[0] = w;
+}
+
+static inline void _yskiplist_merge_build(struct yskiplist_merge *m){
+	//Winners of each match, leaves are at [n, 2n)
+	int *win = m->tree+m->n, t;
+	for(t = 0; t < m->n; t++)
+		win[m->n+t] = t;
+	for(t = m->n-1; t > 0; t--){
+		int a = win[2*t], b = win[2*t+1];
+		bool l = _yskiplist_merge_less(m, a, b);
+		win[t] = l ? a : b;
+		m->tree[t] = l ? b : a;
+	}
+	m->tree[0] = m->n > 1 ? win[1] : 0;
+	m->last = NULL;
+}
+
+/*
+ * yskiplist_merge_new: Create a merge iterator
+ * @heads: the lists to merge, n > 0
+ * @key: gets the key of an element, which can be passed to @cmp
+ * @dedup: skip elements equal to the one returned before them
+ * @return: the iterator, positioned at the start, free it with free()
+ */
+static inline struct yskiplist_merge *
+yskiplist_merge_new(struct yskiplist_head **heads, int n, yskiplist_cmp cmp,
+		    void *(*key)(struct yskiplist_head *), bool dedup){
+	struct yskiplist_merge *m;
+	int i;
+	assert(n > 0);
+	m = malloc(sizeof(*m)+2*n*sizeof(m->heads[0])+3*n*sizeof(m->tree[0]));
+	if (!m)
+		return NULL;
+	m->n = n;
+	m->dedup = dedup;
+	m->cmp = cmp;
+	m->key = key;
+	m->heads = (struct yskiplist_head **)(m+1);
+	m->cur = m->heads+n;
+	m->tree = (int *)(m->cur+n);
+	for(i = 0; i < n; i++){
+		m->heads[i] = heads[i];
+		m->cur[i] = heads[i]->next[0];
+	}
+	_yskiplist_merge_build(m);
+	return m;
+}
+
+//Get the next element without moving forward.
+static inline struct yskiplist_head *
+yskiplist_merge_peek(struct yskiplist_merge *m){
+	return m->cur[m->tree[0]];
+}
+
+//Get the next element, NULL at the end.
+static inline struct yskiplist_head *
+yskiplist_merge_next(struct yskiplist_merge *m){
+	struct yskiplist_head *n;
+	do {
+		int w = m->tree[0];
+		n = m->cur[w];
+		if (!n)
+			return NULL;
+		m->cur[w] = n->next[0];
+		_yskiplist_merge_replay(m, w);
+	} while(m->dedup && m->last && m->cmp(n, m->key(m->last)) == 0);
+	m->last = n;
+	return n;
+}
+
+//Move to the first element greater than or equal to key.
+static inline void
+yskiplist_merge_seek(struct yskiplist_merge *m, void *key){
+	int i;
+	for(i = 0; i < m->n; i++)
+		m->cur[i] = yskiplist_find_ge(m->heads[i], key, m->cmp);
+	_yskiplist_merge_build(m);
+}
+
+/*
+ * Type specialized skiplists.
+ *
+ * YSKIPLIST_DEFINE(name, ktype, kcmp) defines struct name_node, which
+ * stores a key of type ktype right in front of the node header, and
+ * name_insert/find_ge/find_le/extract/first/next functions working on
+ * it. kcmp(a, b) compares two keys and returns <0, 0, or >0, it can be a
+ * macro, e.g. YSKIPLIST_CMP_NUM for plain numbers.
+ *
+ * Since the comparison is inlined into the search loop, and the key sits
+ * in the same cache line as the forward pointers, searches neither make
+ * indirect calls nor touch the containing struct.
+ *
+ * struct name_node must be the last member of the containing struct, and
+ * the containing struct can be allocated with
+ * yskiplist_alloc_entry(head, type, member.sl). name_cmp can be used with
+ * the generic functions, e.g. yskiplist_cut_range().
+ */
+#define YSKIPLIST_CMP_NUM(a, b) (((a) > (b))-((a) < (b)))
+
+#define YSKIPLIST_DEFINE(name, ktype, kcmp)				\
+struct name##_node {							\
+	ktype key;							\
+	struct yskiplist_head sl;					\
+};									\
+									\
+static inline struct name##_node *					\
+name##_entry(struct yskiplist_head *n){					\
+	return n ? container_of(n, struct name##_node, sl) : NULL;	\
+}									\
+									\
+static inline int name##_cmp(struct yskiplist_head *a, void *key){	\
+	return kcmp(name##_entry(a)->key, *(ktype *)key);		\
+}									\
+									\
+/* Same as yskiplist_previous, rank is only used if not NULL */		\
+static inline void							\
+name##_previous(struct yskiplist_head *head, ktype key,			\
+		struct yskiplist_head **res, size_t *rank){		\
+	int i;								\
+	size_t r = 0;							\
+	struct yskiplist_head *n = head, *next;				\
+	for(i = head->level-1; i >= 0; i--){				\
+		while((next = n->next[i]) &&				\
+		      kcmp(name##_entry(next)->key, key) < 0){		\
+			if (rank)					\
+				r += yskiplist_span(n)[i];		\
+			n = next;					\
+		}							\
+		res[i] = n;						\
+		if (rank)						\
+			rank[i] = r;					\
+	}								\
+}									\
+									\
+static inline void							\
+name##_insert(struct yskiplist_head *head, struct name##_node *n){	\
+	struct yskiplist_head *hs[MAX_HEIGHT];				\
+	size_t rank[MAX_HEIGHT];					\
+	if (head->flags&YSKIPLIST_INDEXED) {				\
+		name##_previous(head, n->key, hs, rank);		\
+		_yskiplist_link(head, hs, rank, &n->sl);		\
+	} else {							\
+		name##_previous(head, n->key, hs, NULL);		\
+		_yskiplist_link(head, hs, NULL, &n->sl);		\
+	}								\
+}									\
+									\
+static inline struct name##_node *					\
+name##_find_ge(struct yskiplist_head *head, ktype key){			\
+	struct yskiplist_head *hs[MAX_HEIGHT];				\
+	name##_previous(head, key, hs, NULL);				\
+	return name##_entry(hs[0]->next[0]);				\
+}									\
+									\
+static inline struct name##_node *					\
+name##_find_le(struct yskiplist_head *head, ktype key){			\
+	struct yskiplist_head *hs[MAX_HEIGHT];				\
+	struct yskiplist_head *n;					\
+	name##_previous(head, key, hs, NULL);				\
+	n = hs[0]->next[0];						\
+	if (n && kcmp(name##_entry(n)->key, key) == 0)			\
+		return name##_entry(n);					\
+	return hs[0] == head ? NULL : name##_entry(hs[0]);		\
+}									\
+									\
+static inline struct name##_node *					\
+name##_extract(struct yskiplist_head *head, ktype key){			\
+	struct yskiplist_head *hs[MAX_HEIGHT];				\
+	struct yskiplist_head *n;					\
+	name##_previous(head, key, hs, NULL);				\
+	n = hs[0]->next[0];						\
+	if (!n || kcmp(name##_entry(n)->key, key) != 0)			\
+		return NULL;						\
+	_yskiplist_unlink(head, hs, n);					\
+	return name##_entry(n);						\
+}									\
+									\
+static inline struct name##_node *					\
+name##_first(struct yskiplist_head *head){				\
+	return name##_entry(head->next[0]);				\
+}									\
+									\
+static inline struct name##_node *					\
+name##_next(struct name##_node *n){					\
+	return name##_entry(n->sl.next[0]);				\
+}
@@ -0,0 +1,255 @@
+/* A lock-free variant of yskiplist.
+ *
+ * Uses the same struct yskiplist_head and yskiplist_cmp as yskiplist.h, but
+ * a node's tower only has forward pointers. The lowest bit of a forward
+ * pointer marks the node owning it as deleted (Harris/Fraser style):
+ * deletion first marks the pointers of a node, top level down, and then
+ * unlinks it, either by itself or by anyone who walks by.
+ *
+ * Keys have to be unique. Lookups never write to the list, so they are
+ * wait-free. Insertion and deletion are lock-free, except deletion of a
+ * node whose insertion is still linking its upper levels, which waits for
+ * the insertion to finish.
+ *
+ * All operations must happen inside an epoch critical section (see
+ * yepoch.h), and a node returned by yskiplist_lf_delete() must be freed
+ * with yepoch_retire(), since other threads could still be looking at it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "yskiplist.h"
+#include "yatomic.h"
+
+/* Set in the height of a node while its upper levels are being linked */
+#define YSKIPLIST_LF_LINKING (1<<30)
+
+#define _ylf_marked(p) ((uintptr_t)(p)&1)
+#define _ylf_mark(p) ((struct yskiplist_head *)((uintptr_t)(p)|1))
+#define _ylf_unmark(p) ((struct yskiplist_head *)((uintptr_t)(p)&~(uintptr_t)1))
+#define _ylf_height(n) ((n)->h&~YSKIPLIST_LF_LINKING)
+
+#define yskiplist_lf_tower_size(h) ((size_t)(h)*sizeof(struct yskiplist_head *))
+
+/*
+ * yskiplist_lf_alloc_entry - allocate a struct that embeds a lock-free
+ * skiplist node
+ * @type:	the type of the struct.
+ * @member:	the name of the yskiplist_head within the struct, it must
+ *		be the last member.
+ */
+#define yskiplist_lf_alloc_entry(type, member) ({			\
+	int __h = yskiplist_gen_height();				\
+	type *__e = calloc(1, sizeof(type)+yskiplist_lf_tower_size(__h));\
+	if (__e)							\
+		yskiplist_init_node(&__e->member, __h);			\
+	__e;})
+
+static inline struct yskiplist_head *yskiplist_lf_new_head(void){
+	struct yskiplist_head *h = calloc(1, sizeof(struct yskiplist_head)+
+					  yskiplist_lf_tower_size(MAX_HEIGHT));
+	if (h) {
+		h->h = MAX_HEIGHT;
+		h->level = 1;
+	}
+	return h;
+}
+
+/*
+ * head->level only ever grows, and is raised before a node is linked on the
+ * new levels, so searches can start from there. A search that reads it
+ * before it's raised only misses some shortcuts.
+ */
+static inline int _yskiplist_lf_level(struct yskiplist_head *head){
+	return yatomic_load_acquire(&head->level);
+}
+
+static inline void _yskiplist_lf_raise(struct yskiplist_head *head, int h){
+	unsigned short level = yatomic_load_relaxed(&head->level);
+	while(level < h && !yatomic_cas(&head->level, level, h))
+		level = yatomic_load_relaxed(&head->level);
+}
+
+/*
+ * Find the predecessors and successors of key on every level, unlinking
+ * marked nodes along the way. Above the level of the head they are the
+ * head and NULL.
+ * @return: true if a node equal to key is found, it's in succs[0]
+ */
+static inline bool
+_yskiplist_lf_find(struct yskiplist_head *head, void *key, yskiplist_cmp cmp,
+		   struct yskiplist_head **preds, struct yskiplist_head **succs){
+	int i, top;
+	struct yskiplist_head *pred, *curr, *succ;
+retry:
+	pred = head;
+	top = _yskiplist_lf_level(head);
+	for(i = MAX_HEIGHT-1; i >= top; i--){
+		preds[i] = head;
+		succs[i] = NULL;
+	}
+	for(i = top-1; i >= 0; i--){
+		curr = _ylf_unmark(yatomic_load_acquire(&pred->next[i]));
+		while(curr){
+			succ = yatomic_load_acquire(&curr->next[i]);
+			if (_ylf_marked(succ)) {
+				if (!yatomic_cas(&pred->next[i], curr,
+						 _ylf_unmark(succ)))
+					goto retry;
+				curr = _ylf_unmark(succ);
+				continue;
+			}
+			if (cmp(curr, key) >= 0)
+				break;
+			pred = curr;
+			curr = succ;
+		}
+		preds[i] = pred;
+		succs[i] = curr;
+	}
+	return succs[0] && cmp(succs[0], key) == 0;
+}
+
+/*
+ * Like _yskiplist_lf_find, but doesn't help unlinking, and only gets the
+ * predecessor on level 0.
+ */
+static inline struct yskiplist_head *
+_yskiplist_lf_search(struct yskiplist_head *head, void *key,
+		     yskiplist_cmp cmp, struct yskiplist_head **ppred){
+	int i;
+	struct yskiplist_head *pred = head, *curr = NULL, *succ;
+	for(i = _yskiplist_lf_level(head)-1; i >= 0; i--){
+		curr = _ylf_unmark(yatomic_load_acquire(&pred->next[i]));
+		while(curr){
+			succ = yatomic_load_acquire(&curr->next[i]);
+			if (_ylf_marked(succ)) {
+				curr = _ylf_unmark(succ);
+				continue;
+			}
+			if (cmp(curr, key) >= 0)
+				break;
+			pred = curr;
+			curr = succ;
+		}
+	}
+	if (ppred)
+		*ppred = pred;
+	return curr;
+}
+
+/*
+ * yskiplist_lf_insert: Insert a node into the list
+ * @return: false if a node with the same key is already in the list
+ */
+static inline bool
+yskiplist_lf_insert(struct yskiplist_head *head, struct yskiplist_head *n,
+		    void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+	int i, h = _ylf_height(n);
+
+	n->h = h|YSKIPLIST_LF_LINKING;
+	_yskiplist_lf_raise(head, h);
+	do {
+		if (_yskiplist_lf_find(head, key, cmp, preds, succs)) {
+			n->h = h;
+			return false;
+		}
+		for(i = 0; i < h; i++)
+			yatomic_store_relaxed(&n->next[i], succs[i]);
+	} while(!yatomic_cas(&preds[0]->next[0], succs[0], n));
+
+	for(i = 1; i < h; i++){
+		while(1){
+			struct yskiplist_head *old =
+				yatomic_load_acquire(&n->next[i]);
+			if (_ylf_marked(old))
+				goto out;
+			if (old != succs[i] &&
+			    !yatomic_cas(&n->next[i], old, succs[i]))
+				continue;
+			if (yatomic_cas(&preds[i]->next[i], succs[i], n))
+				break;
+			_yskiplist_lf_find(head, key, cmp, preds, succs);
+			if (succs[0] != n)
+				//Deleted, and already unlinked from level 0
+				goto out;
+		}
+	}
+out:
+	yatomic_fetch_and(&n->h, ~YSKIPLIST_LF_LINKING);
+	return true;
+}
+
+/*
+ * yskiplist_lf_delete: Remove the node equal to key
+ * @return: the node removed, or NULL if not found. The node is no longer
+ * reachable from the list, but other threads could still be accessing it.
+ */
+static inline struct yskiplist_head *
+yskiplist_lf_delete(struct yskiplist_head *head, void *key,
+		    yskiplist_cmp cmp){
+	struct yskiplist_head *preds[MAX_HEIGHT], *succs[MAX_HEIGHT];
+	struct yskiplist_head *node, *succ;
+	int i;
+
+	if (!_yskiplist_lf_find(head, key, cmp, preds, succs))
+		return NULL;
+	node = succs[0];
+	for(i = (yatomic_load_acquire(&node->h)&~YSKIPLIST_LF_LINKING)-1;
+	    i > 0; i--){
+		do {
+			succ = yatomic_load_acquire(&node->next[i]);
+		} while(!_ylf_marked(succ) &&
+			!yatomic_cas(&node->next[i], succ, _ylf_mark(succ)));
+	}
+	do {
+		succ = yatomic_load_acquire(&node->next[0]);
+		if (_ylf_marked(succ))
+			//Someone else deleted it
+			return NULL;
+	} while(!yatomic_cas(&node->next[0], succ, _ylf_mark(succ)));
+
+	/* The inserter could still link node on upper levels, even after
+	 * they are marked, so wait for it to finish before cleaning up */
+	while(yatomic_load_acquire(&node->h)&YSKIPLIST_LF_LINKING)
+		thrd_yield();
+	_yskiplist_lf_find(head, key, cmp, preds, succs);
+	return node;
+}
+
+//Find the smallest element that is greater than or equal to key.
+static inline struct yskiplist_head *
+yskiplist_lf_find_ge(struct yskiplist_head *head, void *key,
+		     yskiplist_cmp cmp){
+	return _yskiplist_lf_search(head, key, cmp, NULL);
+}
+
+//Find the largest element that is less than or equal to key.
+static inline struct yskiplist_head *
+yskiplist_lf_find_le(struct yskiplist_head *head, void *key,
+		     yskiplist_cmp cmp){
+	struct yskiplist_head *pred;
+	struct yskiplist_head *n = _yskiplist_lf_search(head, key, cmp, &pred);
+	if (n && cmp(n, key) == 0)
+		return n;
+	return pred == head ? NULL : pred;
+}
+
+//Get the node after n that isn't deleted, n can be the head.
+static inline struct yskiplist_head *
+yskiplist_lf_next(struct yskiplist_head *n){
+	struct yskiplist_head *curr =
+		_ylf_unmark(yatomic_load_acquire(&n->next[0]));
+	while(curr){
+		struct yskiplist_head *succ =
+			yatomic_load_acquire(&curr->next[0]);
+		if (!_ylf_marked(succ))
+			break;
+		curr = _ylf_unmark(succ);
+	}
+	return curr;
+}
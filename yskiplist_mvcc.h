@@ -0,0 +1,309 @@
+/* Snapshot reads over a yskiplist, concurrent with writers.
+ *
+ * Every write gets a new version number. Nodes record the version that
+ * inserted them and the version that deleted them, and deleting a node
+ * only records the version at first, the node stays linked. A reader
+ * takes a snapshot, which pins the current version, and then sees the
+ * list exactly as it was at that version, no matter what writers do in
+ * the mean time. Readers don't take any lock while iterating.
+ *
+ * A deleted node is unlinked once no snapshot can see it anymore, and
+ * freed once no snapshot that existed when it was unlinked is left, since
+ * a reader could still be standing on it.
+ *
+ * Writers are serialized by a mutex in struct yskiplist_mvcc, which is
+ * also taken briefly to take and release snapshots.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ydef.h"
+#include "ylist.h"
+#include "yatomic.h"
+#include "ythread.h"
+#include "yskiplist.h"
+
+struct yskiplist_mvcc_node {
+	/* Versions that inserted and deleted this node, UINT64_MAX if it
+	 * isn't deleted */
+	uint64_t birth, death;
+	/* For the lists of deleted nodes waiting to be unlinked or freed */
+	struct yskiplist_mvcc_node *gc_next;
+	uint64_t gc_version;
+	struct yskiplist_head sl;
+};
+
+struct yskiplist_mvcc {
+	/* A plain list head, not indexed nor compact */
+	struct yskiplist_head *head;
+	uint64_t version;
+	mtx_t lock;
+	/* Active snapshots, oldest first */
+	struct ylist_head snapshots;
+	/* Deleted nodes that are still linked, in the order of deletion */
+	struct yskiplist_mvcc_node *dead, **dead_tail;
+	/* Unlinked nodes waiting to be freed, in the order of unlinking */
+	struct yskiplist_mvcc_node *retired, **retired_tail;
+	void (*freep)(struct yskiplist_mvcc_node *);
+};
+
+struct yskiplist_mvcc_snapshot {
+	uint64_t version;
+	struct yskiplist_mvcc *l;
+	struct ylist_head list;
+};
+
+#define yskiplist_mvcc_entry(ptr) \
+	container_of(ptr, struct yskiplist_mvcc_node, sl)
+
+/*
+ * yskiplist_mvcc_alloc_entry - allocate a struct that embeds a node
+ * @l:		the list the node is for.
+ * @type:	the type of the struct.
+ * @member:	the name of the yskiplist_mvcc_node within the struct, it
+ *		must be the last member.
+ */
+#define yskiplist_mvcc_alloc_entry(l, type, member) \
+	yskiplist_alloc_entry((l)->head, type, member.sl)
+
+/*
+ * yskiplist_mvcc_init: Initialize an empty list
+ * @freep: called to free nodes that were deleted
+ * @return: 0 on success, -1 if out of memory
+ */
+static inline int
+yskiplist_mvcc_init(struct yskiplist_mvcc *l,
+		    void (*freep)(struct yskiplist_mvcc_node *)){
+	l->head = yskiplist_new_head(0);
+	if (!l->head)
+		return -1;
+	if (mtx_init(&l->lock, mtx_plain) != thrd_success) {
+		yskiplist_free_head(l->head);
+		return -1;
+	}
+	l->version = 0;
+	INIT_YLIST_HEAD(&l->snapshots);
+	l->dead = l->retired = NULL;
+	l->dead_tail = &l->dead;
+	l->retired_tail = &l->retired;
+	l->freep = freep;
+	return 0;
+}
+
+/*
+ * yskiplist_mvcc_deinit: Free the list and all nodes in it
+ *
+ * There must be no snapshots left.
+ */
+static inline void yskiplist_mvcc_deinit(struct yskiplist_mvcc *l){
+	struct yskiplist_head *n = l->head->next[0];
+	assert(ylist_empty(&l->snapshots));
+	while(n){
+		struct yskiplist_head *tmp = n->next[0];
+		l->freep(yskiplist_mvcc_entry(n));
+		n = tmp;
+	}
+	while(l->retired){
+		struct yskiplist_mvcc_node *tmp = l->retired->gc_next;
+		l->freep(l->retired);
+		l->retired = tmp;
+	}
+	yskiplist_free_head(l->head);
+	mtx_destroy(&l->lock);
+}
+
+/*
+ * Link and unlink nodes, publishing the forward pointers with release
+ * stores, since readers walk the list without the lock. Backward pointers
+ * are only used by writers.
+ */
+static inline void
+_yskiplist_mvcc_link(struct yskiplist_head *head, struct yskiplist_head *n,
+		     void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *hs[MAX_HEIGHT], **prev = yskiplist_prev(n);
+	int i;
+	yskiplist_previous(head, key, cmp, hs);
+	for(i = head->level; i < n->h; i++)
+		hs[i] = head;
+	n->flags = head->flags;
+	for(i = 0; i < n->h; i++) {
+		n->next[i] = hs[i]->next[i];
+		prev[i] = hs[i];
+	}
+	for(i = 0; i < n->h; i++) {
+		yatomic_store_release(&hs[i]->next[i], n);
+		if (n->next[i])
+			yskiplist_prev(n->next[i])[i] = n;
+	}
+	if (n->h > head->level)
+		yatomic_store_relaxed(&head->level, n->h);
+}
+
+static inline void
+_yskiplist_mvcc_unlink(struct yskiplist_head *head, struct yskiplist_head *n){
+	struct yskiplist_head **prev = yskiplist_prev(n);
+	unsigned short level = head->level;
+	int i;
+	//n->next is left alone, readers standing on n can carry on
+	for(i = 0; i < n->h; i++) {
+		yatomic_store_release(&prev[i]->next[i], n->next[i]);
+		if (n->next[i])
+			yskiplist_prev(n->next[i])[i] = prev[i];
+	}
+	while(level > 1 && !head->next[level-1])
+		level--;
+	yatomic_store_relaxed(&head->level, level);
+}
+
+/*
+ * Unlink deleted nodes no snapshot can see, and free unlinked nodes no
+ * reader can be on. Called with the lock held.
+ */
+static inline void _yskiplist_mvcc_gc(struct yskiplist_mvcc *l){
+	uint64_t oldest = UINT64_MAX;
+	bool unlinked = false;
+	if (!ylist_empty(&l->snapshots))
+		oldest = ylist_first_entry(&l->snapshots,
+			struct yskiplist_mvcc_snapshot, list)->version;
+
+	while(l->dead && l->dead->death <= oldest){
+		struct yskiplist_mvcc_node *n = l->dead;
+		l->dead = n->gc_next;
+		_yskiplist_mvcc_unlink(l->head, &n->sl);
+		//Snapshots taken from now on can't reach n
+		n->gc_version = l->version+1;
+		n->gc_next = NULL;
+		*l->retired_tail = n;
+		l->retired_tail = &n->gc_next;
+		unlinked = true;
+	}
+	if (!l->dead)
+		l->dead_tail = &l->dead;
+	if (unlinked)
+		l->version++;
+
+	while(l->retired && l->retired->gc_version <= oldest){
+		struct yskiplist_mvcc_node *n = l->retired;
+		l->retired = n->gc_next;
+		l->freep(n);
+	}
+	if (!l->retired)
+		l->retired_tail = &l->retired;
+}
+
+/*
+ * yskiplist_mvcc_insert: Insert a node
+ * @n: the node, allocated by yskiplist_mvcc_alloc_entry()
+ * @return: the version of this write
+ */
+static inline uint64_t
+yskiplist_mvcc_insert(struct yskiplist_mvcc *l, struct yskiplist_mvcc_node *n,
+		      void *key, yskiplist_cmp cmp){
+	uint64_t v;
+	mtx_lock(&l->lock);
+	v = l->version+1;
+	n->birth = v;
+	n->death = UINT64_MAX;
+	_yskiplist_mvcc_link(l->head, &n->sl, key, cmp);
+	l->version = v;
+	_yskiplist_mvcc_gc(l);
+	mtx_unlock(&l->lock);
+	return v;
+}
+
+/*
+ * yskiplist_mvcc_delete: Delete the node equal to key
+ * @return: the version of this write, or 0 if there's no such node
+ *
+ * Snapshots older than the returned version can still see the node.
+ */
+static inline uint64_t
+yskiplist_mvcc_delete(struct yskiplist_mvcc *l, void *key, yskiplist_cmp cmp){
+	struct yskiplist_head *n;
+	uint64_t v = 0;
+	mtx_lock(&l->lock);
+	//Skip over the deleted nodes with the same key
+	for(n = yskiplist_find_ge(l->head, key, cmp);
+	    n && cmp(n, key) == 0; n = n->next[0]) {
+		struct yskiplist_mvcc_node *mn = yskiplist_mvcc_entry(n);
+		if (mn->death != UINT64_MAX)
+			continue;
+		v = ++l->version;
+		yatomic_store_relaxed(&mn->death, v);
+		mn->gc_next = NULL;
+		*l->dead_tail = mn;
+		l->dead_tail = &mn->gc_next;
+		break;
+	}
+	_yskiplist_mvcc_gc(l);
+	mtx_unlock(&l->lock);
+	return v;
+}
+
+//Take a snapshot of the current version of the list.
+static inline void
+yskiplist_mvcc_snapshot(struct yskiplist_mvcc *l,
+			struct yskiplist_mvcc_snapshot *s){
+	mtx_lock(&l->lock);
+	s->l = l;
+	s->version = l->version;
+	ylist_add_tail(&s->list, &l->snapshots);
+	mtx_unlock(&l->lock);
+}
+
+/*
+ * yskiplist_mvcc_release: Drop a snapshot
+ *
+ * Nodes returned through the snapshot must not be used afterwards.
+ */
+static inline void yskiplist_mvcc_release(struct yskiplist_mvcc_snapshot *s){
+	struct yskiplist_mvcc *l = s->l;
+	mtx_lock(&l->lock);
+	ylist_del(&s->list);
+	_yskiplist_mvcc_gc(l);
+	mtx_unlock(&l->lock);
+}
+
+static inline bool
+_yskiplist_mvcc_visible(struct yskiplist_mvcc_snapshot *s,
+			struct yskiplist_head *n){
+	struct yskiplist_mvcc_node *mn = yskiplist_mvcc_entry(n);
+	return mn->birth <= s->version &&
+	       yatomic_load_relaxed(&mn->death) > s->version;
+}
+
+//The first node visible in the snapshot at or after n
+static inline struct yskiplist_mvcc_node *
+_yskiplist_mvcc_skip(struct yskiplist_mvcc_snapshot *s,
+		     struct yskiplist_head *n){
+	while(n && !_yskiplist_mvcc_visible(s, n))
+		n = yatomic_load_acquire(&n->next[0]);
+	return n ? yskiplist_mvcc_entry(n) : NULL;
+}
+
+//Find the smallest node that is greater than or equal to key, in a snapshot.
+static inline struct yskiplist_mvcc_node *
+yskiplist_mvcc_find_ge(struct yskiplist_mvcc_snapshot *s, void *key,
+		       yskiplist_cmp cmp){
+	struct yskiplist_head *x = s->l->head, *n;
+	int i;
+	for(i = yatomic_load_relaxed(&x->level)-1; i >= 0; i--)
+		while((n = yatomic_load_acquire(&x->next[i])) && cmp(n, key) < 0)
+			x = n;
+	return _yskiplist_mvcc_skip(s, yatomic_load_acquire(&x->next[0]));
+}
+
+static inline struct yskiplist_mvcc_node *
+yskiplist_mvcc_first(struct yskiplist_mvcc_snapshot *s){
+	return _yskiplist_mvcc_skip(s, yatomic_load_acquire(&s->l->head->next[0]));
+}
+
+static inline struct yskiplist_mvcc_node *
+yskiplist_mvcc_next(struct yskiplist_mvcc_snapshot *s,
+		    struct yskiplist_mvcc_node *n){
+	return _yskiplist_mvcc_skip(s, yatomic_load_acquire(&n->sl.next[0]));
+}
@@ -0,0 +1,192 @@
+/* A sorted set, like the one in Redis.
+ *
+ * Members are identified by a byte string, and ordered by a score. Each
+ * member is in an indexed yskiplist, ordered by (score, id), and in a
+ * uthash table keyed by id. So looking up a member is O(1), and changing
+ * its score, finding members by score or by rank, and getting the rank of
+ * a member are O(log n).
+ *
+ * struct yzset_node is embedded in the struct of a member, as its last
+ * member, and the struct is allocated with yzset_alloc_entry().
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <uthash.h>
+
+#include "ydef.h"
+#include "yskiplist.h"
+
+struct yzset_node {
+	double score;
+	/* The id isn't copied, it has to live as long as the node */
+	const void *id;
+	size_t idlen;
+	UT_hash_handle hh;
+	struct yskiplist_head sl;
+};
+
+struct yzset {
+	struct yskiplist_head *sl;
+	struct yzset_node *hash;
+};
+
+//Key used for searching the skiplist
+struct _yzset_key {
+	double score;
+	const void *id;
+	size_t idlen;
+	/* Greater than all ids with this score */
+	bool last;
+};
+
+#define yzset_entry(ptr, type, member) \
+	container_of(ptr, type, member)
+
+/*
+ * yzset_alloc_entry - allocate a struct that embeds a yzset_node
+ * @z:		the set the node is for.
+ * @type:	the type of the struct.
+ * @member:	the name of the yzset_node within the struct, it must be
+ *		the last member.
+ */
+#define yzset_alloc_entry(z, type, member) \
+	yskiplist_alloc_entry((z)->sl, type, member.sl)
+
+static inline int _yzset_cmp(struct yskiplist_head *a, void *key){
+	struct yzset_node *n = yskiplist_entry(a, struct yzset_node, sl);
+	struct _yzset_key *k = key;
+	size_t len = n->idlen < k->idlen ? n->idlen : k->idlen;
+	int c;
+	if (n->score != k->score)
+		return n->score < k->score ? -1 : 1;
+	if (k->last)
+		return -1;
+	c = len ? memcmp(n->id, k->id, len) : 0;
+	if (c)
+		return c;
+	return (n->idlen > k->idlen)-(n->idlen < k->idlen);
+}
+
+static inline struct yzset_node *_yzset_node(struct yskiplist_head *n){
+	return n ? yskiplist_entry(n, struct yzset_node, sl) : NULL;
+}
+
+//@return: 0 on success, -1 if out of memory
+static inline int yzset_init(struct yzset *z){
+	z->sl = yskiplist_new_head(YSKIPLIST_INDEXED);
+	z->hash = NULL;
+	return z->sl ? 0 : -1;
+}
+
+/*
+ * yzset_deinit: Free the set
+ * @freep: called on every member, can be NULL
+ */
+static inline void
+yzset_deinit(struct yzset *z, void (*freep)(struct yzset_node *)){
+	struct yskiplist_head *n = z->sl->next[0];
+	HASH_CLEAR(hh, z->hash);
+	while(n){
+		struct yskiplist_head *tmp = n->next[0];
+		if (freep)
+			freep(_yzset_node(n));
+		n = tmp;
+	}
+	yskiplist_free_head(z->sl);
+}
+
+//Find a member by its id.
+static inline struct yzset_node *
+yzset_get(struct yzset *z, const void *id, size_t idlen){
+	struct yzset_node *n;
+	HASH_FIND(hh, z->hash, id, idlen, n);
+	return n;
+}
+
+/*
+ * yzset_add: Add a member
+ * @n: the member, with its score and id set
+ * @return: NULL if added, or the member with the same id, in which case
+ * @n is not added
+ */
+static inline struct yzset_node *yzset_add(struct yzset *z, struct yzset_node *n){
+	struct _yzset_key k = {n->score, n->id, n->idlen, false};
+	struct yzset_node *old = yzset_get(z, n->id, n->idlen);
+	assert(n->score == n->score);
+	if (old)
+		return old;
+	HASH_ADD_KEYPTR(hh, z->hash, n->id, n->idlen, n);
+	yskiplist_insert(z->sl, &n->sl, &k, _yzset_cmp);
+	return NULL;
+}
+
+//Remove a member, it's not freed.
+static inline void yzset_remove(struct yzset *z, struct yzset_node *n){
+	HASH_DEL(z->hash, n);
+	yskiplist_delete(&n->sl);
+}
+
+/*
+ * yzset_update: Change the score of a member
+ *
+ * The member is only moved if it's out of order with its neighbours.
+ */
+static inline void
+yzset_update(struct yzset *z, struct yzset_node *n, double score){
+	struct _yzset_key k = {score, n->id, n->idlen, false};
+	assert(score == score);
+	n->score = score;
+	yskiplist_update_key(z->sl, &n->sl, &k, _yzset_cmp);
+}
+
+static inline size_t yzset_length(struct yzset *z){
+	return HASH_COUNT(z->hash);
+}
+
+//Position of a member, counting from 0 for the lowest score.
+static inline size_t yzset_rank(struct yzset_node *n){
+	return yskiplist_node_rank(&n->sl);
+}
+
+//Get the member at position k, counting from 0.
+static inline struct yzset_node *yzset_by_rank(struct yzset *z, size_t k){
+	return _yzset_node(yskiplist_select(z->sl, k));
+}
+
+//Find the first member whose score is greater than or equal to score.
+static inline struct yzset_node *yzset_first_ge(struct yzset *z, double score){
+	struct _yzset_key k = {score, NULL, 0, false};
+	return _yzset_node(yskiplist_find_ge(z->sl, &k, _yzset_cmp));
+}
+
+//Find the last member whose score is less than or equal to score.
+static inline struct yzset_node *yzset_last_le(struct yzset *z, double score){
+	struct _yzset_key k = {score, NULL, 0, true};
+	struct yskiplist_head *hs[MAX_HEIGHT];
+	yskiplist_previous(z->sl, &k, _yzset_cmp, hs);
+	return hs[0] == z->sl ? NULL : _yzset_node(hs[0]);
+}
+
+//Count the members with scores in [min, max].
+static inline size_t yzset_count(struct yzset *z, double min, double max){
+	struct _yzset_key lo = {min, NULL, 0, false}, hi = {max, NULL, 0, true};
+	return yskiplist_count_range(z->sl, &lo, &hi, _yzset_cmp);
+}
+
+static inline struct yzset_node *yzset_first(struct yzset *z){
+	return _yzset_node(z->sl->next[0]);
+}
+
+static inline struct yzset_node *yzset_next(struct yzset_node *n){
+	return _yzset_node(n->sl.next[0]);
+}
+
+static inline struct yzset_node *yzset_prev(struct yzset_node *n){
+	struct yskiplist_head *p = yskiplist_prev(&n->sl)[0];
+	return p->level ? NULL : _yzset_node(p);
+}